@@ -24,161 +24,1162 @@
  *             sprite, and must be an integer;                               *
  *          framerate is the number of frames it should take to complete the *
  *             sprite's animation cycle, and must be an integer.             *
+ *    The line may end with optional attributes:                             *
+ *             TRANSPARENT c    the character c (a space if omitted) is not  *
+ *                              drawn, so sprites underneath show through    *
+ *             LAYER n          sprites in higher layers are drawn over      *
+ *                              those in lower ones; within a layer, the     *
+ *                              order of the files is kept.  The default     *
+ *                              layer is 0.                                  *
  *    Following this line should be a sequence of images representing what   *
  *      each frame of the sprite's animation should look like.               *
+ *  Files may also contain these directives, which change program options:   *
+ *             FPS n            frames per second to animate at              *
+ *             SINGLE-STEP      advance one frame per keypress               *
+ *             CONTINUOUS       advance frames on a timer (the default)      *
+ *             OUTPUT mode      DIFF (the default) sends only the cells      *
+ *                              that changed since the last frame; FULL      *
+ *                              sends each whole frame with a single write;  *
+ *                              STREAM prints each frame through cout        *
+ *             STATS            print output and timing statistics on exit   *
+ *             THREADS n        draw with n threads (0 for one per core)     *
+ *             PIPELINE         send frames to the terminal on a separate    *
+ *                              thread, skipping any it falls behind on      *
+ *             HEADLESS n       instead of animating, render n frames as     *
+ *                              fast as possible as plain text, and print    *
+ *                              how long it took                             *
+ *             OUTPUT-FILE name where HEADLESS frames go (/dev/null if       *
+ *                              not given)                                   *
+ *             PROFILE          time each stage of every frame, and print a  *
+ *                              summary of the times on exit                 *
+ *             PROFILE-CSV name also write the summary to a CSV file         *
+ *             HUD              show the stage times over the top line of    *
+ *                              the animation as it runs                     *
+ *             FRAME-CACHE n    read the frames of the sprites after it only *
+ *                              when they are drawn, keeping at most n MiB   *
+ *                              of them in memory (0 to read them all up     *
+ *                              front, the default).  On the command line,   *
+ *                              this applies to every file                   *
+ *             START-AT n       start the animation at its nth frame         *
+ *             LOOP n           if the whole scene repeats within n frames,  *
+ *                              encode one cycle before starting, and play   *
+ *                              it back from memory instead of drawing       *
+ *                              (ignored with PIPELINE, HUD or STREAM        *
+ *                              output)                                      *
+ *             RECORD name      also record everything sent to the terminal  *
+ *                              in the named file (not with STREAM output,   *
+ *                              nor with VIEWPORT, whose size can change)    *
+ *             PLAY name        instead of animating, play back a recording  *
+ *                              made with RECORD.  No animation files are    *
+ *                              needed.  START-AT and the keys below work    *
+ *                              on it as they do on an animation             *
+ *             EXPORT-CAST name with PLAY, write the recording to the named  *
+ *                              file in asciicast v2 format instead          *
+ *             SERVE address    instead of showing the animation, run it for *
+ *                              any number of viewers connected to the       *
+ *                              address: a Unix-domain socket's path, or     *
+ *                              [host]:port for TCP.  Runs until interrupted *
+ *             VIEWPORT         show only as much of the canvas as fits the  *
+ *                              terminal, following it as it is resized, and *
+ *                              pan across it with the arrow keys.  Nothing  *
+ *                              outside the view is drawn, so the canvas may *
+ *                              be far larger than the screen.  LOOP is      *
+ *                              ignored with it, and it is ignored with      *
+ *                              SERVE; with HEADLESS, the view stays the     *
+ *                              size the terminal was at the start           *
+ *  While it runs, > and < jump ten seconds ahead or back, 0 goes back to    *
+ *    the start, and q quits.  With VIEWPORT, the arrow keys, or h, j, k and *
+ *    l, move the view a quarter of its size at a time.                      *
+ *  Files may also be scenes compiled with scenec.out, which load faster.    *
+ *  Any directive other than SPRITE can also be given on the command line,   *
+ *    in lower case and preceded by --, as in "--fps 60" or "--stats".       *
+ *    These are applied after every file is read, so they override them.     *
  *                                                                           *
  *  TO DO:                                                                   *
  *  - Options should include bounce or wrap.                                 *
  *  - Option to stop animation after a certain number of frames (or seconds) *
- *  - Allow command-line options, which would override options in the file   *
  *  - Process user commands while things are running.  Perhaps allow users   *
  *    to select certain sprites and, eg, change their speed or position.     *
- *  - Attach a layer to each frame, then sort them by layer before drawing.  *
 \*---------------------------------------------------------------------------*/
 #include <iostream>
 #include <string>
 #include <fstream>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <thread>
+#include <csignal>
+#include <fcntl.h>
 #include <unistd.h>
 #include "termfuncs.h"
 #include "image.h"
 #include "sprite.h"
+#include "sprite_system.h"
+#include "frame_atlas.h"
+#include "frame_encoder.h"
+#include "thread_pool.h"
+#include "compositor.h"
+#include "layer_cache.h"
+#include "scheduler.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "scene_file.h"
+#include "scene_parser.h"
+#include "frame_cache.h"
+#include "frame_loop.h"
+#include "recording.h"
+#include "broadcast.h"
+#include "terminal.h"
 using namespace std;
 
 
+enum OutputMode { DIFF_OUTPUT, FULL_OUTPUT, STREAM_OUTPUT };
+
 static bool SINGLE_STEP = false;
 static const char QUIT = 'q';
+static const char JUMP_AHEAD = '>';
+static const char JUMP_BACK = '<';
+static const char RESTART = '0';
+static const char PAN_LEFT = 'h';
+static const char PAN_DOWN = 'j';
+static const char PAN_UP = 'k';
+static const char PAN_RIGHT = 'l';
 static unsigned FPS = 30;
-static const unsigned USECS_PER_SEC = 1000000;
+static OutputMode OUTPUT = DIFF_OUTPUT;
+static bool SHOW_STATS = false;
+static unsigned THREADS = 1;
+static bool PIPELINE = false;
+static unsigned HEADLESS = 0;
+static string OUTPUT_FILE = "/dev/null";
+static bool PROFILE = false;
+static string PROFILE_CSV;
+static bool SHOW_HUD = false;
+static unsigned FRAME_CACHE = 0;
+static unsigned long START_AT = 0;
+static unsigned long LOOP = 0;
+static string RECORD;
+static string PLAY;
+static string EXPORT_CAST;
+static string SERVE;
+static bool VIEWPORT = false;
+
+//  How far JUMP_AHEAD and JUMP_BACK move, in seconds of animation.
+static const unsigned JUMP_SECONDS = 10;
+
+//  Set by SIGINT or SIGTERM to stop run_server().
+static volatile sig_atomic_t STOP_SERVING = 0;
 
+//  How often the HUD's figures are brought up to date, in nanoseconds.
+static const long long HUD_REFRESH = 500000000;
+
+//  The directives that may be given as command-line options, and how many
+//    arguments each takes.
+static const struct {
+    char const *name;
+    unsigned arguments;
+} OPTIONS[] = {
+    { "canvas", 2 }, { "fps", 1 }, { "single-step", 0 }, { "continuous", 0 },
+    { "output", 1 }, { "stats", 0 }, { "threads", 1 }, { "pipeline", 0 },
+    { "headless", 1 }, { "output-file", 1 }, { "profile", 0 },
+    { "profile-csv", 1 }, { "hud", 0 }, { "frame-cache", 1 },
+    { "start-at", 1 }, { "loop", 1 }, { "record", 1 }, { "play", 1 },
+    { "export-cast", 1 }, { "serve", 1 }, { "viewport", 0 }
+};
+static const unsigned NUM_OPTIONS = sizeof(OPTIONS) / sizeof(OPTIONS[0]);
+
+//  The settings given by the directives in one file, or on the command line.
+//    Those not given are left empty, or false, so that applying each file's
+//    settings in turn keeps the last value given for each, wherever it was.
+struct Settings
+{
+    optional<unsigned> canvas_height, canvas_width;
+    optional<unsigned> fps;
+    optional<bool> single_step;
+    optional<OutputMode> output;
+    bool stats = false;
+    optional<unsigned> threads;
+    bool pipeline = false;
+    optional<unsigned> headless;
+    optional<string> output_file;
+    bool profile = false;
+    optional<string> profile_csv;
+    bool hud = false;
+    optional<unsigned> frame_cache;
+    optional<unsigned long> start_at;
+    optional<unsigned long> loop;
+    optional<string> record, play, export_cast;
+    optional<string> serve;
+    bool viewport = false;
+};
+
+//  The size of the canvas: the world the sprites move in, which with
+//    VIEWPORT is more than is ever drawn at once.
+struct CanvasSize
+{
+    unsigned height = 0, width = 0;
+};
+
+//  What was read from one file: its sprites, its settings, and a message
+//    for cerr if something went wrong.
+struct LoadedFile
+{
+    vector<Sprite> sprites;
+    Settings settings;
+    string error;
+};
 
-string toupper(string s);
-vector<Sprite> read_in(int size, char *files[], Image<char> *canvas);
-void process_file(istream &input, vector<Sprite> *sprites,
-                  Image<char> *canvas);
-void run_animation(Image<char> *canvas, vector<Sprite> sprites);
+
+bool read_options(int size, char *args[], vector<char *> *files,
+                  string *directives);
+vector<Sprite> read_in(int size, char *files[], CanvasSize *world,
+                       FrameAtlas *atlas, FrameCache *cache, bool lazy);
+void load_file(char const *name, LoadedFile *loaded, FrameAtlas *atlas,
+               FrameCache *cache, bool lazy);
+bool process_file(SceneParser &parser, vector<Sprite> *sprites,
+                  Settings *settings, FrameAtlas *atlas);
+void apply_settings(Settings const &settings, CanvasSize *world);
+void fit_viewport(CanvasSize const &world, Image<char> *canvas,
+                  SpriteSystem *sprites);
+void run_animation(Image<char> *canvas, SpriteSystem *sprites,
+                   Image<char> const &background);
+int run_headless(Image<char> *canvas, SpriteSystem *sprites,
+                 Image<char> const &background);
+int play_recording(void);
+int run_server(Image<char> *canvas, SpriteSystem *sprites,
+               Image<char> const &background);
+bool jump(char key, unsigned long *tick);
+bool pan(char key, unsigned *escape, SpriteSystem *sprites,
+         Image<char> const &canvas);
+void draw_hud(Image<char> *board, string const &line);
+void report_profile(FrameProfiler const &profiler);
 
 
 int main(int argc, char *argv[])
 {
-    Image<char> canvas;
-    if (argc < 2) {
+    CanvasSize world;
+    FrameAtlas atlas;
+    FrameCache cache;
+    vector<char *> files;
+    string overrides;
+    if (!read_options(argc - 1, argv + 1, &files, &overrides)) {
+        return 1;
+    }
+    SceneParser options(overrides);
+    Settings settings;
+    vector<Sprite> sprites;
+    if (!process_file(options, &sprites, &settings, &atlas)) {
+        cerr << "Command line options: " << options.get_error() << endl;
+        return 1;
+    }
+    if (files.empty() && !settings.play) {
         cerr << "Please provide at least one filename." << endl;
         return 1;
     }
-    vector<Sprite> sprites = read_in(argc - 1, argv + 1, &canvas);
-    run_animation(&canvas, sprites);
-    return 0;
+    bool lazy = settings.frame_cache && *settings.frame_cache != 0;
+    if (!files.empty()) {
+        sprites = read_in(files.size(), &files[0], &world, &atlas, &cache,
+                          lazy);
+    }
+    apply_settings(settings, &world);
+    if (!PLAY.empty()) return play_recording();
+    if (FRAME_CACHE != 0) cache.set_capacity((size_t) FRAME_CACHE << 20);
+    bool viewport = VIEWPORT && SERVE.empty();
+    if (viewport && HEADLESS == 0 && !RECORD.empty()) {
+        cerr << "RECORD cannot be used with VIEWPORT, since the view can "
+             << "change size" << endl;
+        return 1;
+    }
+    SpriteSystem system(sprites);
+    Image<char> canvas, background;
+    if (viewport) {
+        fit_viewport(world, &canvas, &system);
+    } else {
+        canvas = Image<char>(world.height, world.width);
+        background = Image<char>(world.height, world.width);
+        background.set_all(' ');
+        system.bake_static(&background);
+    }
+    if (START_AT != 0) system.seek(START_AT, world.height, world.width);
+    int status = 0;
+    if (!SERVE.empty()) {
+        status = run_server(&canvas, &system, background);
+    } else if (HEADLESS > 0) {
+        status = run_headless(&canvas, &system, background);
+    } else {
+        run_animation(&canvas, &system, background);
+    }
+    if (SHOW_STATS && cache.size() != 0) cache.print_stats(cerr);
+    return status;
+}
+
+
+/*  read_options()
+ *  Purpose:  Sorts the command line into file names and options.
+ *  Parameters: The number of arguments, and an array of them.  A pointer to
+ *            a vector that the file names are added to.  A pointer to a
+ *            string that each option is added to, written as the directive
+ *            it stands for, so it can be handled by process_file().
+ *  Returns:  False, after printing a message to cerr, if an option is
+ *            unknown or is missing its arguments.
+ */
+bool read_options(int size, char *args[], vector<char *> *files,
+                  string *directives)
+{
+    for (int i = 0; i < size; ++i) {
+        if (strncmp(args[i], "--", 2) != 0) {
+            files->push_back(args[i]);
+            continue;
+        }
+        unsigned option = 0;
+        while (option < NUM_OPTIONS &&
+               strcmp(args[i] + 2, OPTIONS[option].name) != 0) {
+            ++option;
+        }
+        if (option == NUM_OPTIONS) {
+            cerr << "Unknown option \"" << args[i] << "\"" << endl;
+            return false;
+        }
+        if (i + (int) OPTIONS[option].arguments >= size) {
+            cerr << "Option \"" << args[i] << "\" needs "
+                 << OPTIONS[option].arguments << " argument(s)" << endl;
+            return false;
+        }
+        *directives += args[i] + 2;
+        for (unsigned a = 0; a < OPTIONS[option].arguments; ++a) {
+            *directives += ' ';
+            *directives += args[++i];
+        }
+        *directives += '\n';
+    }
+    return true;
 }
 
 
 /*  read_in()
  *  Purpose:  Reads information from the given list of files.  Creates an array
- *            of sprites, and updates the canvas and program options to reflect
- *            what is read.
+ *            of sprites, and updates the canvas size and program options to
+ *            reflect what is read.
  *  Parameters: The number of files to read, and an array of their names.
- *            A pointer to the canvas, whose size may be modified.
+ *            A pointer to the canvas size, which may be modified.  A pointer
+ *            to the atlas the sprites' frames will be shared through.  A
+ *            pointer to the cache frames are indexed in when read lazily,
+ *            and whether every file should be read lazily from its start.
  *  Returns:  A vector of the sprites read in.
- *  Notes:  - Prints to cerr when a given file cannot be opened, but does not
- *            abort.
+ *  Notes:  - Prints to cerr when a given file cannot be opened, or has an
+ *            error in it, but does not abort.
+ *          - The files are read at the same time on a ThreadPool, each into
+ *            its own LoadedFile.  Their sprites, settings and errors are then
+ *            taken in the order the files were given, so the result is the
+ *            same as reading them one after another.
  */
-vector<Sprite> read_in(int size, char *files[], Image<char> *canvas)
+vector<Sprite> read_in(int size, char *files[], CanvasSize *world,
+                       FrameAtlas *atlas, FrameCache *cache, bool lazy)
 {
+    vector<LoadedFile> loaded(size);
+    unsigned cores = max(thread::hardware_concurrency(), 1u);
+    ThreadPool pool(min((unsigned) size, cores));
+    pool.run(size, [&](unsigned i) {
+        load_file(files[i], &loaded[i], atlas, cache, lazy);
+    });
     vector<Sprite> sprites;
     for (int i = 0; i < size; ++i) {
-        ifstream input;
-        input.open(files[i]);
-        if (!input.is_open()) {
-            cerr << "Could not open file \"" << files[i] << "\"" << endl;
-            continue;
-        }
-        process_file(input, &sprites, canvas);
-        input.close();
+        if (!loaded[i].error.empty()) cerr << loaded[i].error << endl;
+        apply_settings(loaded[i].settings, world);
+        sprites.insert(sprites.end(),
+                       make_move_iterator(loaded[i].sprites.begin()),
+                       make_move_iterator(loaded[i].sprites.end()));
     }
     return sprites;
 }
 
 
-/*  toupper()
- *  Purpose:  Converts a string to all uppercase.
- *  Parameters:  The string to make uppercase
- *  Returns:  The uppercase'd string
+/*  load_file()
+ *  Purpose:  Reads one file for read_in(), as text or as a compiled scene.
+ *  Parameters: The name of the file.  A pointer to where to put what was
+ *            read.  Pointers to the atlas and the cache, as for read_in(),
+ *            and whether to read the file lazily from its start.
+ *  Notes:  - Touches nothing but the given LoadedFile, the atlas and the
+ *            cache, so may be called for several files at once.
+ *          - Files compiled by scenec.out are loaded with SceneFile::load()
+ *            instead of being read as text.  Their frames are drawn straight
+ *            from the mapped file, so they are never read lazily.
+ *          - Text files are mapped where they can be, so the parser can
+ *            drop what it has read; pipes are read into memory whole.
  */
-string toupper(string s)
+void load_file(char const *name, LoadedFile *loaded, FrameAtlas *atlas,
+               FrameCache *cache, bool lazy)
 {
-    unsigned size = s.length();
-    for (unsigned i = 0; i < size; ++i) {
-        s[i] = toupper(s[i]);
+    if (SceneFile::is_scene_file(name)) {
+        unsigned height = 0, width = 0, fps;
+        if (!SceneFile::load(name, &loaded->sprites, &height, &width, &fps,
+                             atlas, &loaded->error)) {
+            loaded->error = "Could not load scene \"" + string(name) +
+                            "\": " + loaded->error;
+            return;
+        }
+        if (height != 0 && width != 0) {
+            loaded->settings.canvas_height = height;
+            loaded->settings.canvas_width = width;
+        }
+        if (fps != 0) loaded->settings.fps = fps;
+        return;
+    }
+    size_t size = 0;
+    char const *mapped = SceneParser::map_file(name, &size);
+    string text;
+    if (mapped == NULL && !SceneParser::read_file(name, &text)) {
+        loaded->error = "Could not open file \"" + string(name) + "\"";
+        return;
     }
-    return s;
+    SceneParser parser(mapped != NULL ? string_view(mapped, size)
+                                      : string_view(text));
+    parser.set_mapped(mapped != NULL);
+    parser.set_frame_cache(cache, name);
+    parser.set_lazy(lazy);
+    if (!process_file(parser, &loaded->sprites, &loaded->settings, atlas)) {
+        loaded->error = string(name) + ", " + parser.get_error();
+    }
+    SceneParser::unmap_file(mapped, size);
 }
 
 
 /*  process_file()
- *  Purpose:  Reads data from a given stream and updates data according to
- *            the instructions therein.
- *  Parameters:  A reference to the stream to read from.  Pointers to the
- *            vector of sprites and the canvas, both of which may be modified.
- *  Notes:  - Handles program settings by currently setting global variables.
- *            May change that to take in some sort of Settings object.
+ *  Purpose:  Reads data through the given parser and updates data according
+ *            to the instructions therein.
+ *  Parameters:  The parser to read with.  Pointers to the vector of sprites
+ *            and the settings, both of which may be modified.  A pointer to
+ *            the atlas the sprites' frames are shared through.
+ *  Returns:  False if the parser stopped on an error.  Everything before the
+ *            error has been applied; nothing after it has.
+ *  Notes:  - Directives only change the given settings, which take effect
+ *            when passed to apply_settings().  FRAME-CACHE also decides
+ *            whether the parser reads the sprites after it lazily.
+ *          - Unknown words are skipped.
  */
-void process_file(istream &input, vector<Sprite> *sprites, Image<char> *canvas)
+bool process_file(SceneParser &parser, vector<Sprite> *sprites,
+                  Settings *settings, FrameAtlas *atlas)
 {
-    string first;
-    while (input >> first) {
-        first = toupper(first);
-        if (first == "CANVAS") {
+    auto read_word = [&parser](string_view *word, char const *what) {
+        return parser.next_word(word) ||
+               parser.fail(string("expected ") + what +
+                           ", but the file ended");
+    };
+    string_view first, word;
+    unsigned number;
+    unsigned long tick;
+    while (parser.next_word(&first)) {
+        if (SceneParser::same_word(first, "CANVAS")) {
             unsigned height, width;
-            if (input >> height >> width) {
-                canvas->set_height(height);
-                canvas->set_width(width);
+            if (!parser.read_number(&height) || !parser.read_number(&width)) {
+                break;
+            }
+            settings->canvas_height = height;
+            settings->canvas_width = width;
+        } else if (SceneParser::same_word(first, "SPRITE")) {
+            Sprite current(atlas);
+            if (!parser.read_sprite(&current)) break;
+            sprites->push_back(std::move(current));
+        } else if (SceneParser::same_word(first, "FPS")) {
+            if (parser.read_number(&number)) settings->fps = number;
+        } else if (SceneParser::same_word(first, "SINGLE-STEP")) {
+            settings->single_step = true;
+        } else if (SceneParser::same_word(first, "CONTINUOUS")) {
+            settings->single_step = false;
+        } else if (SceneParser::same_word(first, "OUTPUT")) {
+            if (!read_word(&word, "an output mode")) break;
+            if (SceneParser::same_word(word, "DIFF")) {
+                settings->output = DIFF_OUTPUT;
+            } else if (SceneParser::same_word(word, "FULL")) {
+                settings->output = FULL_OUTPUT;
+            } else if (SceneParser::same_word(word, "STREAM")) {
+                settings->output = STREAM_OUTPUT;
+            } else {
+                parser.fail("unknown output mode \"" + string(word) + "\"");
+            }
+        } else if (SceneParser::same_word(first, "STATS")) {
+            settings->stats = true;
+        } else if (SceneParser::same_word(first, "THREADS")) {
+            if (parser.read_number(&number)) settings->threads = number;
+        } else if (SceneParser::same_word(first, "PIPELINE")) {
+            settings->pipeline = true;
+        } else if (SceneParser::same_word(first, "HEADLESS")) {
+            if (parser.read_number(&number)) settings->headless = number;
+        } else if (SceneParser::same_word(first, "OUTPUT-FILE")) {
+            if (read_word(&word, "a file name")) {
+                settings->output_file = string(word);
+            }
+        } else if (SceneParser::same_word(first, "PROFILE")) {
+            settings->profile = true;
+        } else if (SceneParser::same_word(first, "PROFILE-CSV")) {
+            if (read_word(&word, "a file name")) {
+                settings->profile_csv = string(word);
+            }
+        } else if (SceneParser::same_word(first, "HUD")) {
+            settings->hud = true;
+        } else if (SceneParser::same_word(first, "FRAME-CACHE")) {
+            if (parser.read_number(&number)) {
+                settings->frame_cache = number;
+                parser.set_lazy(number != 0);
             }
-        } else if (first == "SPRITE") {
-            Sprite current;
-            if (input >> current) {
-                sprites->push_back(current);
+        } else if (SceneParser::same_word(first, "START-AT")) {
+            if (parser.read_number(&tick)) settings->start_at = tick;
+        } else if (SceneParser::same_word(first, "LOOP")) {
+            if (parser.read_number(&tick)) settings->loop = tick;
+        } else if (SceneParser::same_word(first, "RECORD")) {
+            if (read_word(&word, "a file name")) {
+                settings->record = string(word);
             }
-        } else if (first == "FPS") {
-            input >> FPS;
-        } else if (first == "SINGLE-STEP") {
-            SINGLE_STEP = true;
-        } else if (first == "CONTINUOUS") {
-            SINGLE_STEP = false;
+        } else if (SceneParser::same_word(first, "PLAY")) {
+            if (read_word(&word, "a file name")) {
+                settings->play = string(word);
+            }
+        } else if (SceneParser::same_word(first, "EXPORT-CAST")) {
+            if (read_word(&word, "a file name")) {
+                settings->export_cast = string(word);
+            }
+        } else if (SceneParser::same_word(first, "SERVE")) {
+            if (read_word(&word, "an address")) {
+                settings->serve = string(word);
+            }
+        } else if (SceneParser::same_word(first, "VIEWPORT")) {
+            settings->viewport = true;
         }
     }
+    return !parser.failed();
+}
+
+
+/*  apply_settings()
+ *  Purpose:  Puts the given settings into effect, over any given before.
+ *  Parameters: The settings.  A pointer to the canvas size, which may be
+ *            modified.
+ *  Notes:  - Handles program settings by currently setting global variables.
+ *            Settings that were not given are left as they were.
+ */
+void apply_settings(Settings const &settings, CanvasSize *world)
+{
+    if (settings.canvas_height && settings.canvas_width) {
+        world->height = *settings.canvas_height;
+        world->width = *settings.canvas_width;
+    }
+    if (settings.fps) FPS = *settings.fps;
+    if (settings.single_step) SINGLE_STEP = *settings.single_step;
+    if (settings.output) OUTPUT = *settings.output;
+    if (settings.stats) SHOW_STATS = true;
+    if (settings.threads) THREADS = *settings.threads;
+    if (settings.pipeline) PIPELINE = true;
+    if (settings.headless) HEADLESS = *settings.headless;
+    if (settings.output_file) OUTPUT_FILE = *settings.output_file;
+    if (settings.profile) PROFILE = true;
+    if (settings.profile_csv) PROFILE_CSV = *settings.profile_csv;
+    if (settings.hud) SHOW_HUD = true;
+    if (settings.frame_cache) FRAME_CACHE = *settings.frame_cache;
+    if (settings.start_at) START_AT = *settings.start_at;
+    if (settings.loop) LOOP = *settings.loop;
+    if (settings.record) RECORD = *settings.record;
+    if (settings.play) PLAY = *settings.play;
+    if (settings.export_cast) EXPORT_CAST = *settings.export_cast;
+    if (settings.serve) SERVE = *settings.serve;
+    if (settings.viewport) VIEWPORT = true;
+}
+
+
+/*  fit_viewport()
+ *  Purpose:  Sizes the canvas to show as much of the world as fits in the
+ *            terminal, and sets the sprites' viewport to match.
+ *  Parameters: The size of the world.  Pointers to the canvas, which is
+ *            resized, and to the sprites.
+ *  Notes:  - The terminal's last row is left free, so that nothing scrolls.
+ *            If standard output is not a terminal, 24 by 80 is assumed.
+ *          - The view's corner stays where it was, unless that would take
+ *            the view past the edge of the world.
+ */
+void fit_viewport(CanvasSize const &world, Image<char> *canvas,
+                  SpriteSystem *sprites)
+{
+    unsigned rows = 24, cols = 80;
+    if (TerminalSession::get_size(&rows, &cols) && rows > 1) --rows;
+    unsigned height = min(rows, world.height);
+    unsigned width = min(cols, world.width);
+    Viewport view = sprites->get_viewport(canvas->get_height(),
+                                          canvas->get_width());
+    view.world_height = world.height;
+    view.world_width = world.width;
+    view.top = min(view.top, world.height - height);
+    view.left = min(view.left, world.width - width);
+    canvas->set_height(height);
+    canvas->set_width(width);
+    sprites->set_viewport(view);
 }
 
 
 /*  run_animation()
  *  Purpose:  To show the animation on cout, with the given canvas and sprites
  *  Parameters: A pointer to a canvas to use, which will be modified over
- *            the course of the animation.  A vector of sprites to use.
+ *            the course of the animation.  A pointer to the sprites to use,
+ *            which will be advanced as the animation runs.  The background
+ *            each frame starts from, with any static sprites already drawn.
  *  Notes:  - Runs until the user presses the QUIT character.  Changes behavior
- *            based on SINGLE_STEP.  When it is false, uses FPS to control the
- *            frame rate.
+ *            based on SINGLE_STEP.  When it is false, a FrameScheduler keeps
+ *            the frame rate at FPS by the clock, skipping the drawing of
+ *            frames while it is behind.
+ *          - OUTPUT chooses between sending only the changes through a
+ *            DiffRenderer, sending whole frames through a FrameEncoder, and
+ *            printing whole frames through cout.
+ *          - Layers are drawn through a LayerCache, so layers that have not
+ *            changed are reused.  With more than one thread, each layer is
+ *            drawn by a TileCompositor.
+ *          - With PIPELINE, frames are drawn into a FramePipeline's canvases
+ *            instead, and sent out by its thread while the next is drawn.
+ *          - With PROFILE, PROFILE-CSV or HUD, each stage of every frame is
+ *            timed by a FrameProfiler.  When PIPELINE is on, encoding and
+ *            writing are timed on the output thread.
+ *          - A TerminalSession sets the terminal up for reading keys once,
+ *            for the whole run.  Keys are waited for alongside the next
+ *            deadline, so QUIT takes effect as soon as it is pressed.  In
+ *            SINGLE_STEP mode, running out of input also ends the run.
+ *          - The jump keys are handled by jump() as soon as they are read.
+ *          - With LOOP, a FrameLoop is built first if it can be.  Each tick
+ *            is then sent straight from it.  For DIFF output, its frames only
+ *            follow on from the tick before, so after a skipped tick or a
+ *            jump, one tick is drawn and sent whole as usual.
+ *          - With RECORD, every frame sent is also handed to a
+ *            SessionRecorder, which writes it out on its own thread.  With
+ *            PIPELINE, the tick recorded with a frame is the one the main
+ *            thread had reached when it was sent, which may be a later one.
+ *          - With VIEWPORT, the canvas shows the sprites' viewport, and the
+ *            pan keys are handled by pan().  When the terminal is resized,
+ *            the canvas is fitted to it again by fit_viewport() and the
+ *            screen is redrawn from scratch; with PIPELINE, the pipeline is
+ *            finished and a new one started for the new size.  A recording
+ *            has one size throughout, so main() does not allow RECORD with
+ *            VIEWPORT.
  */
-void run_animation(Image<char> *canvas, vector<Sprite> sprites)
+void run_animation(Image<char> *canvas, SpriteSystem *sprites,
+                   Image<char> const &background)
 {
-    unsigned height = canvas->get_height();
-    unsigned width = canvas->get_width();
-    unsigned num_sprites = sprites.size();
+    Viewport view = sprites->get_viewport(canvas->get_height(),
+                                          canvas->get_width());
+    CanvasSize world;
+    world.height = view.world_height;
+    world.width = view.world_width;
+    unsigned height = world.height;
+    unsigned width = world.width;
+    FrameEncoder encoder(STDOUT_FILENO);
+    DiffRenderer renderer(&encoder);
+    ThreadPool pool(THREADS == 0 ? thread::hardware_concurrency() : THREADS);
+    TileCompositor compositor(&pool);
+    LayerCache layers(background);
+    FrameScheduler scheduler(FPS);
+    TerminalSession session;
+    FrameProfiler timings;
+    bool timed = PROFILE || SHOW_HUD || !PROFILE_CSV.empty();
+    FrameProfiler *profiler = timed ? &timings : NULL;
+    FrameLoop loop;
+    if (LOOP != 0 && !PIPELINE && !SHOW_HUD && OUTPUT != STREAM_OUTPUT &&
+        !VIEWPORT) {
+        loop.build(sprites, &layers, (pool.size() > 1) ? &compositor : NULL,
+                   canvas, LOOP, (OUTPUT == DIFF_OUTPUT) ? FrameLoop::DIFF
+                                                         : FrameLoop::FULL);
+    }
+    bool looping = !loop.empty();
+    bool resync = looping && OUTPUT == DIFF_OUTPUT;
+    unsigned long tick = sprites->get_tick();
+    layers.set_profiler(profiler);
+    SessionRecorder recorder;
+    string error;
+    if (!RECORD.empty() && OUTPUT != STREAM_OUTPUT &&
+        !recorder.open(RECORD.c_str(), canvas->get_height(),
+                       canvas->get_width(), FPS, &error)) {
+        cerr << "Could not record to \"" << RECORD << "\": " << error << endl;
+    }
+    atomic<unsigned long> shown_tick(tick);
+    string hud;
+    long long hud_time = 0;
+    auto show = [&](Image<char> const &frame) {
+        {
+            StageTimer timing(profiler, STAGE_ENCODE);
+            if (OUTPUT == DIFF_OUTPUT) {
+                renderer.encode(frame);
+            } else if (OUTPUT == FULL_OUTPUT) {
+                encoder.begin_frame();
+                encoder.encode_full(frame);
+            } else {
+                screen_home();
+                frame.display(cout);
+            }
+        }
+        StageTimer timing(profiler, STAGE_WRITE);
+        if (OUTPUT == STREAM_OUTPUT) {
+            cout << flush;
+        } else {
+            encoder.flush();
+            string const &sent = encoder.get_buffer();
+            recorder.record(shown_tick.load(memory_order_relaxed),
+                            sent.data(), sent.size());
+        }
+    };
+    unsigned escape = 0;
+    auto handle_key = [&](char key) {
+        pan(key, &escape, sprites, *canvas);
+        if (!jump(key, &tick)) return;
+        if (looping) {
+            resync = (OUTPUT == DIFF_OUTPUT);
+        } else {
+            sprites->seek(tick, height, width);
+        }
+    };
     char c = '\0';
     screen_clear();
+    cout << flush;
+    unique_ptr<FramePipeline> pipeline;
+    if (PIPELINE) pipeline.reset(new FramePipeline(*canvas, show));
     do {
-        screen_home();
-        canvas->set_all(' ');
-        for (unsigned i = 0; i < num_sprites; ++i) {
-            sprites[i].draw_to(canvas);
-            sprites[i].advance(height, width);
+        if (session.was_resized() && VIEWPORT) {
+            if (pipeline) pipeline->finish();
+            fit_viewport(world, canvas, sprites);
+            renderer.invalidate();
+            screen_clear();
+            cout << flush;
+            if (pipeline) pipeline.reset(new FramePipeline(*canvas, show));
         }
-        canvas->display(cout);
+        bool present = SINGLE_STEP || scheduler.should_present();
+        if (present && looping && !resync) {
+            StageTimer timing(profiler, STAGE_WRITE);
+            string_view frame = loop.get(tick);
+            encoder.send(frame.data(), frame.size());
+            recorder.record(tick, frame.data(), frame.size());
+        } else if (present) {
+            if (resync) {
+                sprites->seek(tick, height, width);
+                renderer.invalidate();
+                resync = false;
+            }
+            Image<char> *board = pipeline ? pipeline->get_canvas() : canvas;
+            layers.draw_to(*sprites, board,
+                           (pool.size() > 1) ? &compositor : NULL);
+            if (SHOW_HUD) {
+                if (FrameScheduler::now() - hud_time >= HUD_REFRESH) {
+                    hud = timings.hud_line();
+                    hud_time = FrameScheduler::now();
+                }
+                draw_hud(board, hud);
+            }
+            shown_tick.store(tick, memory_order_relaxed);
+            if (pipeline) {
+                pipeline->publish();
+            } else {
+                show(*board);
+            }
+        } else if (looping) {
+            resync = (OUTPUT == DIFF_OUTPUT);
+        }
+        {
+            StageTimer timing(profiler, STAGE_ADVANCE);
+            if (!looping) sprites->advance(height, width);
+            ++tick;
+        }
+        StageTimer timing(profiler, STAGE_INPUT);
         if (SINGLE_STEP) {
-            c = getachar();
+            c = session.read_key();
+            if (session.at_eof()) break;
+            handle_key(c);
         } else {
-            c = getacharnow(0);
-            usleep(USECS_PER_SEC / FPS);
+            scheduler.frame_done(present);
+            c = '\0';
+            while (c != QUIT &&
+                   scheduler.wait_for_input(session.input_fd())) {
+                c = session.read_ready_key();
+                handle_key(c);
+            }
         }
     } while (c != QUIT);
+    if (pipeline) pipeline->finish();
+    bool recorded = recorder.is_open();
+    if (recorded && !recorder.close(&error)) {
+        cerr << "Could not record to \"" << RECORD << "\": " << error << endl;
+    }
+    if (SHOW_STATS) {
+        if (OUTPUT != STREAM_OUTPUT) encoder.print_stats(cerr);
+        if (!SINGLE_STEP) scheduler.print_stats(cerr);
+        if (pipeline) pipeline->print_stats(cerr);
+        if (LOOP != 0) loop.print_stats(cerr);
+        if (recorded) recorder.print_stats(cerr);
+    }
+    if (timed) report_profile(timings);
 }
 
+
+/*  run_headless()
+ *  Purpose:  To render HEADLESS frames of the animation as fast as possible,
+ *            and report how fast that was.
+ *  Parameters: The same as run_animation().
+ *  Returns:  0, or 1 if OUTPUT_FILE could not be opened or written.
+ *  Notes:  - Each frame is written to OUTPUT_FILE as its rows of plain text,
+ *            with no control sequences, so the file can be read as is.
+ *          - There is no sleeping and no input.  Frames per second, the
+ *            time taken to draw each sprite, and the bytes written are
+ *            printed to cerr at the end.
+ *          - With LOOP, if a FrameLoop can be built, every frame is written
+ *            straight from it instead, and nothing is drawn.  The time
+ *            building it is not counted.
+ */
+int run_headless(Image<char> *canvas, SpriteSystem *sprites,
+                 Image<char> const &background)
+{
+    int fd = open(OUTPUT_FILE.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << "Could not open file \"" << OUTPUT_FILE << "\"" << endl;
+        return 1;
+    }
+    Viewport view = sprites->get_viewport(canvas->get_height(),
+                                          canvas->get_width());
+    unsigned height = view.world_height;
+    unsigned width = view.world_width;
+    FrameEncoder encoder(fd);
+    ThreadPool pool(THREADS == 0 ? thread::hardware_concurrency() : THREADS);
+    TileCompositor compositor(&pool);
+    LayerCache layers(background);
+    FrameProfiler timings;
+    bool timed = PROFILE || !PROFILE_CSV.empty();
+    FrameProfiler *profiler = timed ? &timings : NULL;
+    FrameLoop loop;
+    if (LOOP != 0 && !VIEWPORT) {
+        loop.build(sprites, &layers, (pool.size() > 1) ? &compositor : NULL,
+                   canvas, LOOP, FrameLoop::PLAIN);
+    }
+    layers.set_profiler(profiler);
+    unsigned long first = sprites->get_tick();
+    long long drawing = 0;
+    long long start = FrameScheduler::now();
+    bool written = true;
+    for (unsigned long tick = 0; tick < HEADLESS && written; ++tick) {
+        if (!loop.empty()) {
+            StageTimer timing(profiler, STAGE_WRITE);
+            string_view frame = loop.get(first + tick);
+            written = encoder.send(frame.data(), frame.size());
+            continue;
+        }
+        long long before = FrameScheduler::now();
+        layers.draw_to(*sprites, canvas,
+                       (pool.size() > 1) ? &compositor : NULL);
+        drawing += FrameScheduler::now() - before;
+        {
+            StageTimer timing(profiler, STAGE_ENCODE);
+            encoder.begin_frame();
+            encoder.encode_plain(*canvas);
+        }
+        {
+            StageTimer timing(profiler, STAGE_WRITE);
+            written = encoder.flush();
+        }
+        StageTimer timing(profiler, STAGE_ADVANCE);
+        sprites->advance(height, width);
+    }
+    double elapsed = (FrameScheduler::now() - start) / 1e9;
+    close(fd);
+    if (!written) {
+        cerr << "Could not write to \"" << OUTPUT_FILE << "\"" << endl;
+        return 1;
+    }
+    double draws = (double) HEADLESS * sprites->size();
+    cerr << "frames: " << HEADLESS
+         << "  fps: " << (elapsed > 0 ? HEADLESS / elapsed : 0)
+         << "  ns/sprite-draw: " << (draws > 0 ? drawing / draws : 0)
+         << "  bytes: " << encoder.get_bytes() << endl;
+    if (SHOW_STATS && LOOP != 0) loop.print_stats(cerr);
+    if (timed) report_profile(timings);
+    return 0;
+}
+
+
+/*  on_stop()
+ *  Purpose:  A helper function that handles SIGINT and SIGTERM while
+ *            serving, by asking run_server() to stop.
+ */
+static void on_stop(int)
+{
+    STOP_SERVING = 1;
+}
+
+
+/*  run_server()
+ *  Purpose:  To run the animation for the viewers connected to SERVE, by a
+ *            BroadcastServer, instead of on cout.
+ *  Parameters: The same as run_animation().
+ *  Returns:  0, or 1 if the server could not listen at the address.
+ *  Notes:  - Each tick is drawn and encoded once for every viewer: a delta
+ *            through a DiffRenderer, and a keyframe only when a viewer
+ *            needs one.  Nothing is drawn while no one is watching.
+ *          - A FrameScheduler keeps the frame rate at FPS, skipping ticks
+ *            while behind, as in run_animation().  Between ticks, the
+ *            server's epoll descriptor is waited on with the deadline, so
+ *            viewers are served as soon as their sockets are ready.
+ *          - Runs until SIGINT or SIGTERM, then prints statistics as asked
+ *            and closes the server, which removes a Unix-domain socket.
+ *            LOOP, RECORD and the keys do not apply.
+ */
+int run_server(Image<char> *canvas, SpriteSystem *sprites,
+               Image<char> const &background)
+{
+    BroadcastServer server;
+    string error;
+    if (!server.listen(SERVE.c_str(), &error)) {
+        cerr << "Could not serve on \"" << SERVE << "\": " << error << endl;
+        return 1;
+    }
+    unsigned height = canvas->get_height();
+    unsigned width = canvas->get_width();
+    FrameEncoder encoder(-1);
+    DiffRenderer renderer(&encoder);
+    ThreadPool pool(THREADS == 0 ? thread::hardware_concurrency() : THREADS);
+    TileCompositor compositor(&pool);
+    LayerCache layers(background);
+    FrameScheduler scheduler(FPS);
+    FrameProfiler timings;
+    bool timed = PROFILE || !PROFILE_CSV.empty();
+    FrameProfiler *profiler = timed ? &timings : NULL;
+    layers.set_profiler(profiler);
+
+    struct sigaction action, previous[2];
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &previous[0]);
+    sigaction(SIGTERM, &action, &previous[1]);
+    STOP_SERVING = 0;
+    shared_ptr<string const> keyframe, delta;
+    while (!STOP_SERVING) {
+        bool present = scheduler.should_present();
+        if (present && server.viewers() > 0) {
+            layers.draw_to(*sprites, canvas,
+                           (pool.size() > 1) ? &compositor : NULL);
+            {
+                StageTimer timing(profiler, STAGE_ENCODE);
+                renderer.encode(*canvas);
+                delta = make_shared<string const>(encoder.get_buffer());
+                keyframe.reset();
+                if (server.wants_keyframe()) {
+                    encoder.begin_frame();
+                    encoder.encode_full(*canvas);
+                    keyframe = make_shared<string const>(encoder.get_buffer());
+                }
+            }
+            StageTimer timing(profiler, STAGE_WRITE);
+            server.broadcast(keyframe, delta);
+        }
+        {
+            StageTimer timing(profiler, STAGE_ADVANCE);
+            sprites->advance(height, width);
+        }
+        StageTimer timing(profiler, STAGE_INPUT);
+        scheduler.frame_done(present);
+        while (!STOP_SERVING && scheduler.wait_for_input(server.get_fd())) {
+            server.service();
+        }
+    }
+    sigaction(SIGINT, &previous[0], NULL);
+    sigaction(SIGTERM, &previous[1], NULL);
+    if (SHOW_STATS) {
+        scheduler.print_stats(cerr);
+        server.print_stats(cerr);
+    }
+    if (timed) report_profile(timings);
+    return 0;
+}
+
+
+/*  play_recording()
+ *  Purpose:  To play back the recording named by PLAY on cout, or with
+ *            EXPORT_CAST, to write it out in asciicast v2 format.
+ *  Returns:  0, or 1 if the recording could not be read or the asciicast
+ *            could not be written.
+ *  Notes:  - Frames are sent at the times they were recorded at, by the
+ *            clock, and keys are read while waiting for them.  QUIT quits,
+ *            even once the recording has ended.
+ *          - START_AT and the jump keys count ticks at the frame rate the
+ *            recording was made at.  To go to a tick, the reader seeks to
+ *            the keyframe before it, and every frame from there up to the
+ *            tick is sent with a single write().  A tick before the first
+ *            frame has nothing to show yet, so the screen is cleared.
+ */
+int play_recording(void)
+{
+    RecordingReader reader;
+    string error;
+    if (!reader.open(PLAY.c_str(), &error)) {
+        cerr << "Could not play \"" << PLAY << "\": " << error << endl;
+        return 1;
+    }
+    if (!EXPORT_CAST.empty()) {
+        ofstream output(EXPORT_CAST);
+        if (!output.is_open() || !reader.write_asciicast(output)) {
+            cerr << "Could not write \"" << EXPORT_CAST << "\"" << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (reader.get_fps() != 0) FPS = reader.get_fps();
+    long long tick_time = 1000000000LL / max(FPS, 1u);
+    FrameEncoder encoder(STDOUT_FILENO);
+    TerminalSession session;
+    unsigned long tick = START_AT;
+    string catch_up;
+    char c = '\0';
+    screen_clear();
+    cout << flush;
+    while (c != QUIT) {
+        long long shown = tick * tick_time;
+        reader.seek(shown);
+        catch_up.clear();
+        RecordedFrame frame;
+        bool more;
+        while ((more = reader.next(&frame)) && frame.time <= shown) {
+            catch_up.append(frame.bytes);
+        }
+        if (catch_up.empty()) {
+            screen_clear();
+            cout << flush;
+        } else {
+            encoder.send(catch_up.data(), catch_up.size());
+        }
+        long long origin = FrameScheduler::now() - shown;
+        bool jumped = false;
+        while (!jumped && c != QUIT) {
+            if (!more) {
+                c = session.read_key();
+                if (session.at_eof()) c = QUIT;
+            } else if (FrameScheduler::wait_until(origin + frame.time,
+                                                  session.input_fd())) {
+                c = session.read_ready_key();
+            } else {
+                encoder.send(frame.bytes.data(), frame.bytes.size());
+                shown = frame.time;
+                more = reader.next(&frame);
+                continue;
+            }
+            tick = shown / tick_time;
+            jumped = jump(c, &tick);
+        }
+    }
+    if (SHOW_STATS) encoder.print_stats(cerr);
+    return 0;
+}
+
+
+/*  jump()
+ *  Purpose:  Moves the given tick if the given key is one of the jump keys:
+ *            JUMP_SECONDS ahead or back for JUMP_AHEAD and JUMP_BACK, or to
+ *            the start for RESTART.
+ *  Returns:  Whether the key was a jump key.
+ *  Notes:  - Seconds are counted at FPS frames each.  Jumping back from less
+ *            than JUMP_SECONDS in goes to the start.
+ */
+bool jump(char key, unsigned long *tick)
+{
+    unsigned long distance = (unsigned long) JUMP_SECONDS * FPS;
+    if (key == JUMP_AHEAD) {
+        *tick += distance;
+    } else if (key == JUMP_BACK) {
+        *tick = (*tick > distance) ? *tick - distance : 0;
+    } else if (key == RESTART) {
+        *tick = 0;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+/*  pan()
+ *  Purpose:  Moves the sprites' viewport a quarter of the canvas's size if
+ *            the given key is one of the pan keys or finishes an arrow key,
+ *            keeping the view within the world.
+ *  Parameters: The key.  A pointer to how far through an arrow key's escape
+ *            sequence the keys before it got, kept from call to call.  A
+ *            pointer to the sprites.  The canvas showing the view.
+ *  Returns:  Whether the view moved.
+ *  Notes:  - Arrow keys arrive as ESC [ or ESC O, then A, B, C or D for up,
+ *            down, right or left.
+ *          - Without a viewport the view is the whole world, and so cannot
+ *            move.
+ */
+bool pan(char key, unsigned *escape, SpriteSystem *sprites,
+         Image<char> const &canvas)
+{
+    if (*escape == 1) {
+        *escape = (key == '[' || key == 'O') ? 2 : 0;
+        return false;
+    }
+    if (*escape == 2) {
+        *escape = 0;
+        if (key == 'A') {
+            key = PAN_UP;
+        } else if (key == 'B') {
+            key = PAN_DOWN;
+        } else if (key == 'C') {
+            key = PAN_RIGHT;
+        } else if (key == 'D') {
+            key = PAN_LEFT;
+        } else {
+            return false;
+        }
+    }
+    if (key == '\033') {
+        *escape = 1;
+        return false;
+    }
+    unsigned height = canvas.get_height();
+    unsigned width = canvas.get_width();
+    Viewport view = sprites->get_viewport(height, width);
+    unsigned rows = max(height / 4, 1u), cols = max(width / 4, 1u);
+    unsigned bottom = view.world_height - height;
+    unsigned right = view.world_width - width;
+    Viewport moved = view;
+    if (key == PAN_UP) {
+        moved.top = (view.top > rows) ? view.top - rows : 0;
+    } else if (key == PAN_DOWN) {
+        moved.top = min(view.top + rows, bottom);
+    } else if (key == PAN_LEFT) {
+        moved.left = (view.left > cols) ? view.left - cols : 0;
+    } else if (key == PAN_RIGHT) {
+        moved.left = min(view.left + cols, right);
+    }
+    if (moved == view) return false;
+    sprites->set_viewport(moved);
+    return true;
+}
+
+
+/*  draw_hud()
+ *  Purpose:  Writes the given line over the top row of the image, cut short
+ *            if it is wider than the image.
+ */
+void draw_hud(Image<char> *board, string const &line)
+{
+    if (board->get_height() == 0) return;
+    unsigned length = min((unsigned) line.length(), board->get_width());
+    copy(line.begin(), line.begin() + length, board->row(0));
+}
+
+
+/*  report_profile()
+ *  Purpose:  Prints the profiler's summary to cerr if PROFILE is set, and
+ *            writes it to PROFILE_CSV if that is set.
+ */
+void report_profile(FrameProfiler const &profiler)
+{
+    if (PROFILE) profiler.print_summary(cerr);
+    if (PROFILE_CSV.empty()) return;
+    ofstream output(PROFILE_CSV.c_str());
+    if (!output.is_open()) {
+        cerr << "Could not open file \"" << PROFILE_CSV << "\"" << endl;
+        return;
+    }
+    profiler.write_csv(output);
+}
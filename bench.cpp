@@ -0,0 +1,334 @@
+/*---------------------------------------------------------------------------*\
+ *  bench.cpp                                                                *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Microbenchmarks for the core of the animation program, built with        *
+ *    optimization by "make bench".                                          *
+ *  Each benchmark runs on a synthetic scene: a canvas of some size, and a   *
+ *    number of sprites of some size with some number of frames, placed and  *
+ *    moving at random but from a fixed seed, so every run sees the same     *
+ *    scene.  The scene is also written out in the animation file format, to *
+ *    time reading it back in, both with Sprite::read_in() and with a        *
+ *    SceneParser.                                                           *
+ *  The benchmarks follow what the animation does each tick: advancing or    *
+ *    seeking the SpriteSystem, clearing the canvas and drawing every layer  *
+ *    through a LayerCache, serially and with a TileCompositor, and encoding *
+ *    the frame with a DiffRenderer or whole with a FrameEncoder.  All of it *
+ *    is then timed together, as one tick of a running animation.            *
+ *  Every benchmark is timed over several samples, each a batch of calls     *
+ *    long enough for the clock to measure well, and the median is reported. *
+ *    Results are printed as CSV on cout, one line per benchmark and scene,  *
+ *    with times in nanoseconds per call of the function named.  Calls that  *
+ *    handle one sprite are timed over every sprite in the scene and divided *
+ *    down, so the figures are per sprite.                                   *
+ *                                                                           *
+ *  Usage:  bench.out [--canvas h w] [--sprites n] [--size h w]              *
+ *                    [--frames n] [--samples n]                             *
+ *    With no scene options, a small, a medium and a large scene are run.    *
+ *    Any scene option runs just one scene, with the rest left as in the     *
+ *    medium one.                                                            *
+\*---------------------------------------------------------------------------*/
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include "image.h"
+#include "sprite.h"
+#include "sprite_system.h"
+#include "frame_atlas.h"
+#include "frame_encoder.h"
+#include "thread_pool.h"
+#include "compositor.h"
+#include "layer_cache.h"
+#include "scene_parser.h"
+using namespace std;
+
+//  The parameters of one synthetic scene.
+struct Scene
+{
+    unsigned canvas_height, canvas_width;
+    unsigned sprites;
+    unsigned sprite_height, sprite_width;
+    unsigned frames;
+};
+
+static const Scene SMALL = { 24, 80, 10, 3, 5, 2 };
+static const Scene MEDIUM = { 60, 200, 100, 6, 12, 4 };
+static const Scene LARGE = { 200, 600, 1000, 10, 20, 8 };
+
+static unsigned SAMPLES = 15;
+
+//  Each sample runs for at least this long.
+static const long long MIN_SAMPLE_NS = 2000000;
+
+//  Results are written here so the compiler cannot drop the work.
+static volatile char SINK;
+
+
+long long now(void);
+double median_ns(function<void(void)> const &operation);
+string make_scene_text(Scene const &scene);
+vector<Sprite> read_scene(string const &text, FrameAtlas *atlas);
+vector<Sprite> parse_scene(string const &text, FrameAtlas *atlas);
+void run_scene(Scene const &scene);
+void report(char const *name, Scene const &scene, double ns);
+
+
+int main(int argc, char *argv[])
+{
+    Scene scene = MEDIUM;
+    bool custom = false;
+    for (int i = 1; i < argc; ++i) {
+        int left = argc - i - 1;
+        if (strcmp(argv[i], "--canvas") == 0 && left >= 2) {
+            scene.canvas_height = atoi(argv[++i]);
+            scene.canvas_width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sprites") == 0 && left >= 1) {
+            scene.sprites = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && left >= 2) {
+            scene.sprite_height = atoi(argv[++i]);
+            scene.sprite_width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && left >= 1) {
+            scene.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--samples") == 0 && left >= 1) {
+            SAMPLES = max(atoi(argv[++i]), 1);
+            continue;
+        } else {
+            cerr << "Unknown or incomplete option \"" << argv[i] << "\""
+                 << endl;
+            return 1;
+        }
+        custom = true;
+    }
+    if (scene.canvas_height == 0 || scene.canvas_width == 0 ||
+        scene.sprite_height == 0 || scene.sprite_width == 0 ||
+        scene.frames == 0) {
+        cerr << "Sizes and the frame count must not be 0" << endl;
+        return 1;
+    }
+    cout << "benchmark,canvas_height,canvas_width,sprites,sprite_height,"
+         << "sprite_width,frames,samples,median_ns" << endl;
+    if (custom) {
+        run_scene(scene);
+    } else {
+        run_scene(SMALL);
+        run_scene(MEDIUM);
+        run_scene(LARGE);
+    }
+    return 0;
+}
+
+
+/*  now()
+ *  Purpose:  Returns the time on the monotonic clock, in nanoseconds.
+ */
+long long now(void)
+{
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+    return current.tv_sec * 1000000000LL + current.tv_nsec;
+}
+
+
+/*  median_ns()
+ *  Purpose:  Times the given operation.
+ *  Returns:  The median, over SAMPLES samples, of the nanoseconds per call.
+ *  Notes:  - The batch size is doubled until one batch takes MIN_SAMPLE_NS,
+ *            which also warms up the caches, before any sample is kept.
+ */
+double median_ns(function<void(void)> const &operation)
+{
+    unsigned long batch = 1;
+    for (;;) {
+        long long start = now();
+        for (unsigned long i = 0; i < batch; ++i) operation();
+        if (now() - start >= MIN_SAMPLE_NS) break;
+        batch *= 2;
+    }
+    vector<double> samples(SAMPLES);
+    for (unsigned s = 0; s < SAMPLES; ++s) {
+        long long start = now();
+        for (unsigned long i = 0; i < batch; ++i) operation();
+        samples[s] = (double) (now() - start) / batch;
+    }
+    sort(samples.begin(), samples.end());
+    return samples[SAMPLES / 2];
+}
+
+
+/*  make_scene_text()
+ *  Purpose:  Writes out a random scene with the given parameters, in the
+ *            format of an animation file, without the CANVAS line.
+ *  Notes:  - Each sprite's frames are drawn with their own characters, so
+ *            a FrameAtlas finds nothing to share.
+ */
+string make_scene_text(Scene const &scene)
+{
+    mt19937 random(12345);
+    uniform_real_distribution<double> row(0, scene.canvas_height);
+    uniform_real_distribution<double> col(0, scene.canvas_width);
+    uniform_real_distribution<double> speed(-1, 1);
+    uniform_int_distribution<int> letter('!', '~');
+    ostringstream text;
+    for (unsigned s = 0; s < scene.sprites; ++s) {
+        text << "SPRITE " << scene.sprite_height << " "
+             << scene.sprite_width << " " << row(random) << " "
+             << col(random) << " " << speed(random) << " " << speed(random)
+             << " " << scene.frames << " " << scene.frames * 2 << "\n";
+        for (unsigned f = 0; f < scene.frames; ++f) {
+            for (unsigned r = 0; r < scene.sprite_height; ++r) {
+                for (unsigned c = 0; c < scene.sprite_width; ++c) {
+                    text << (char) letter(random);
+                }
+                text << "\n";
+            }
+        }
+    }
+    return text.str();
+}
+
+
+/*  read_scene()
+ *  Purpose:  Reads back the sprites written by make_scene_text(), the way
+ *            the animation program does.
+ */
+vector<Sprite> read_scene(string const &text, FrameAtlas *atlas)
+{
+    istringstream input(text);
+    vector<Sprite> sprites;
+    string first;
+    while (input >> first) {
+        Sprite current(atlas);
+        if (input >> current) {
+            sprites.push_back(std::move(current));
+        }
+    }
+    return sprites;
+}
+
+
+/*  parse_scene()
+ *  Purpose:  Like read_scene(), but reads with a SceneParser.
+ */
+vector<Sprite> parse_scene(string const &text, FrameAtlas *atlas)
+{
+    SceneParser parser(text);
+    vector<Sprite> sprites;
+    string_view first;
+    while (parser.next_word(&first)) {
+        Sprite current(atlas);
+        if (!parser.read_sprite(&current)) break;
+        sprites.push_back(std::move(current));
+    }
+    return sprites;
+}
+
+
+/*  run_scene()
+ *  Purpose:  Runs every benchmark on one scene, and reports the results.
+ *  Notes:  - Drawing is timed with the LayerCache emptied before each call,
+ *            so every layer is drawn, as it is whenever the bottom layer
+ *            moves.  The tick benchmark keeps the cache, as the animation
+ *            does.
+ *          - The encoders are given a file descriptor of -1, and are never
+ *            flushed, so only encoding is timed.
+ */
+void run_scene(Scene const &scene)
+{
+    string text = make_scene_text(scene);
+    FrameAtlas atlas;
+    SpriteSystem system(read_scene(text, &atlas));
+    unsigned height = scene.canvas_height;
+    unsigned width = scene.canvas_width;
+    Image<char> canvas(height, width);
+    canvas.set_all(' ');
+    double per_sprite = (system.size() == 0) ? 0 : 1.0 / system.size();
+
+    report("Image::set_all", scene, median_ns([&] {
+        canvas.set_all(' ');
+        SINK = canvas.at_unchecked(0, 0);
+    }));
+
+    report("SpriteSystem::advance", scene, per_sprite * median_ns([&] {
+        system.advance(height, width);
+    }));
+
+    unsigned long to = 0;
+    report("SpriteSystem::seek", scene, per_sprite * median_ns([&] {
+        to = (to + 7919) % 100000;
+        system.seek(to, height, width);
+    }));
+
+    system.seek(0, height, width);
+    LayerCache layers;
+    report("LayerCache::draw_to", scene, median_ns([&] {
+        layers.invalidate();
+        layers.draw_to(system, &canvas, NULL);
+        SINK = canvas.at_unchecked(0, 0);
+    }));
+
+    ThreadPool pool(max(thread::hardware_concurrency(), 1u));
+    TileCompositor compositor(&pool);
+    report("TileCompositor::draw_range", scene, median_ns([&] {
+        layers.invalidate();
+        layers.draw_to(system, &canvas, &compositor);
+        SINK = canvas.at_unchecked(0, 0);
+    }));
+
+    FrameEncoder encoder(-1);
+    DiffRenderer renderer(&encoder);
+    Image<char> frames[2] = { Image<char>(height, width),
+                              Image<char>(height, width) };
+    system.seek(0, height, width);
+    layers.draw_to(system, &frames[0], NULL);
+    system.advance(height, width);
+    layers.draw_to(system, &frames[1], NULL);
+    unsigned next = 0;
+    report("DiffRenderer::encode", scene, median_ns([&] {
+        renderer.encode(frames[next]);
+        next ^= 1;
+    }));
+
+    report("FrameEncoder::encode_full", scene, median_ns([&] {
+        encoder.begin_frame();
+        encoder.encode_full(frames[0]);
+    }));
+
+    system.seek(0, height, width);
+    renderer.invalidate();
+    report("tick", scene, median_ns([&] {
+        layers.draw_to(system, &canvas, (pool.size() > 1) ? &compositor
+                                                          : NULL);
+        renderer.encode(canvas);
+        system.advance(height, width);
+    }));
+
+    report("Sprite::read_in", scene, per_sprite * median_ns([&] {
+        FrameAtlas fresh;
+        SINK = (char) read_scene(text, &fresh).size();
+    }));
+
+    report("SceneParser::read_sprite", scene, per_sprite * median_ns([&] {
+        FrameAtlas fresh;
+        SINK = (char) parse_scene(text, &fresh).size();
+    }));
+}
+
+
+/*  report()
+ *  Purpose:  Prints one line of results.
+ */
+void report(char const *name, Scene const &scene, double ns)
+{
+    cout << name << "," << scene.canvas_height << "," << scene.canvas_width
+         << "," << scene.sprites << "," << scene.sprite_height << ","
+         << scene.sprite_width << "," << scene.frames << "," << SAMPLES
+         << "," << ns << endl;
+}
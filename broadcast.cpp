@@ -0,0 +1,418 @@
+/*---------------------------------------------------------------------------*\
+ *  broadcast.cpp                                                            *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the BroadcastServer class.                       *
+\*---------------------------------------------------------------------------*/
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "broadcast.h"
+using namespace std;
+
+//  What a viewer is sent first, to clear whatever was on its terminal.
+static const char CLEAR_SCREEN[] = "\033[H\033[2J";
+
+//  The most events handled by one call of service().
+static const int MAX_EVENTS = 64;
+
+
+/*  Default constructor makes a server that is not yet listening.
+ */
+BroadcastServer::BroadcastServer(void)
+{
+    listen_fd = epoll_fd = spare_fd = -1;
+    clear_screen = make_shared<string const>(CLEAR_SCREEN);
+    served = refused = frames = keyframes = skipped = bytes = 0;
+}
+
+
+/*  Destructor disconnects every viewer and stops listening, removing the
+ *    socket if it was a Unix-domain one.
+ */
+BroadcastServer::~BroadcastServer(void)
+{
+    for (auto const &client : clients) close(client.first);
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (listen_fd >= 0) close(listen_fd);
+    if (spare_fd >= 0) close(spare_fd);
+    if (!socket_path.empty()) unlink(socket_path.c_str());
+}
+
+
+/*  open_tcp()
+ *  Purpose:  A helper function that opens a non-blocking socket listening
+ *            on the given host and port.  An empty host means every address
+ *            of the machine.
+ *  Returns:  The socket, or -1, with a message in the given string.
+ */
+static int open_tcp(string const &host, string const &port, string *error)
+{
+    struct addrinfo hints, *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int status = getaddrinfo(host.empty() ? NULL : host.c_str(),
+                             port.c_str(), &hints, &found);
+    if (status != 0) {
+        *error = gai_strerror(status);
+        return -1;
+    }
+    int fd = -1;
+    *error = "no address to listen on";
+    for (struct addrinfo *a = found; a != NULL && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family,
+                    a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    a->ai_protocol);
+        if (fd < 0) continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) < 0 ||
+            ::listen(fd, SOMAXCONN) < 0) {
+            *error = strerror(errno);
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+
+/*  open_unix()
+ *  Purpose:  A helper function that opens a non-blocking Unix-domain socket
+ *            listening at the given path.
+ *  Returns:  The socket, or -1, with a message in the given string.
+ *  Notes:  - A socket already at the path, left by an earlier run, is
+ *            replaced.  Anything else there is left alone, and is an error.
+ */
+static int open_unix(string const &path, string *error)
+{
+    struct sockaddr_un where;
+    memset(&where, 0, sizeof(where));
+    where.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(where.sun_path)) {
+        *error = "the path is too long for a socket";
+        return -1;
+    }
+    memcpy(where.sun_path, path.c_str(), path.size() + 1);
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path.c_str());
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &where, sizeof(where)) < 0 ||
+        ::listen(fd, SOMAXCONN) < 0) {
+        *error = strerror(errno);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/*  listen()
+ *  Purpose:  Starts listening for viewers at the given address.
+ *  Parameters: The address: a port, as in ":4000", or a host and a port, as
+ *            in "localhost:4000", to listen on TCP, or otherwise the path of
+ *            a Unix-domain socket.  A string to describe any error in.
+ *  Returns:  True if the server is listening.
+ */
+bool BroadcastServer::listen(char const *address, string *error)
+{
+    string text(address);
+    size_t colon = text.rfind(':');
+    bool tcp = colon != string::npos && colon + 1 < text.size() &&
+               text.find_first_not_of("0123456789", colon + 1) ==
+                   string::npos;
+    if (tcp) {
+        listen_fd = open_tcp(text.substr(0, colon), text.substr(colon + 1),
+                             error);
+    } else {
+        listen_fd = open_unix(text, error);
+        if (listen_fd >= 0) socket_path = text;
+    }
+    if (listen_fd < 0) return false;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    if (epoll_fd < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0) {
+        *error = "could not set up epoll";
+        return false;
+    }
+    spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return true;
+}
+
+
+/*  get_fd()
+ *  Purpose:  Returns the file descriptor that is ready to read whenever the
+ *            server has something to do in service().
+ */
+int BroadcastServer::get_fd(void) const
+{
+    return epoll_fd;
+}
+
+
+/*  service()
+ *  Purpose:  Handles whatever the sockets are ready for, without waiting:
+ *            accepts new viewers, sends more of the frames that did not fit
+ *            in a viewer's socket before, and drops viewers that have gone.
+ *  Notes:  - Handles at most MAX_EVENTS sockets.  Any more stay ready, so
+ *            the next wait returns at once for the caller to call it again.
+ */
+void BroadcastServer::service(void)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, 0);
+    for (int e = 0; e < ready; ++e) {
+        int fd = events[e].data.fd;
+        if (fd == listen_fd) {
+            accept_viewers();
+            continue;
+        }
+        auto found = clients.find(fd);
+        if (found == clients.end()) continue;
+        uint32_t happened = events[e].events;
+        bool alive = !(happened & EPOLLERR);
+        if (alive && (happened & EPOLLIN)) {
+            alive = drain_input(fd, &found->second);
+        }
+        if (alive && (happened & EPOLLOUT)) {
+            alive = send_frame(fd, &found->second);
+        }
+        if (!alive || (happened & EPOLLHUP)) drop(fd);
+    }
+}
+
+
+/*  wants_keyframe()
+ *  Purpose:  Returns whether any viewer will need a keyframe at the next
+ *            broadcast(), so the caller only encodes one when it is used.
+ */
+bool BroadcastServer::wants_keyframe(void) const
+{
+    for (auto const &client : clients) {
+        if (client.second.stale || client.second.frame) return true;
+    }
+    return false;
+}
+
+
+/*  broadcast()
+ *  Purpose:  Starts sending a new frame to every viewer.
+ *  Parameters: The frame in full, which may be empty if wants_keyframe()
+ *            said no viewer needs it.  The frame as a delta from the one
+ *            broadcast before it.
+ *  Notes:  - A viewer still being sent an earlier frame skips this one, and
+ *            is marked stale.  A stale viewer with nothing left to send is
+ *            sent the keyframe, which brings it up to date.  Every other
+ *            viewer is sent the delta.
+ *          - As much as fits is sent straight away.  The rest is sent by
+ *            service() as the viewer's socket makes room for it.
+ */
+void BroadcastServer::broadcast(shared_ptr<string const> const &keyframe,
+                                shared_ptr<string const> const &delta)
+{
+    ++frames;
+    auto client = clients.begin();
+    while (client != clients.end()) {
+        int fd = client->first;
+        Viewer *viewer = &client->second;
+        ++client;
+        if (viewer->frame) {
+            viewer->stale = true;
+            ++skipped;
+            continue;
+        }
+        if (viewer->stale) {
+            if (!keyframe) continue;
+            viewer->frame = keyframe;
+            viewer->stale = false;
+            ++keyframes;
+        } else if (delta && !delta->empty()) {
+            viewer->frame = delta;
+        } else {
+            continue;
+        }
+        viewer->sent = 0;
+        if (!send_frame(fd, viewer)) drop(fd);
+    }
+}
+
+
+/*  viewers()
+ *  Purpose:  Returns the number of viewers connected.
+ */
+unsigned BroadcastServer::viewers(void) const
+{
+    return clients.size();
+}
+
+
+/*  print_stats()
+ *  Purpose:  Prints how many viewers there have been, and how many frames
+ *            and bytes were sent to them, on one line.
+ */
+void BroadcastServer::print_stats(ostream &output) const
+{
+    output << "broadcast: " << served << " viewers served, " << refused
+           << " refused, " << frames
+           << " frames, " << keyframes << " keyframes sent, " << skipped
+           << " frames skipped by slow viewers, " << bytes / 1024
+           << " KiB sent" << endl;
+}
+
+
+/*  accept_viewers()
+ *  Purpose:  A helper function that accepts every viewer waiting to
+ *            connect, and starts clearing its screen.
+ *  Notes:  - A new viewer is stale, so its first frame is a keyframe.
+ *          - Out of file descriptors, the listening socket would stay ready
+ *            to read, and the caller would spin; so waiting viewers are
+ *            turned away by refuse_viewer() instead, until none are left.
+ */
+void BroadcastServer::accept_viewers(void)
+{
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0 && errno == EINTR) continue;
+        if (fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+            if (refuse_viewer()) continue;
+            return;
+        }
+        if (fd < 0) return;
+        Viewer viewer;
+        viewer.frame = clear_screen;
+        viewer.sent = 0;
+        viewer.stale = true;
+        viewer.reading = true;
+        viewer.blocked = false;
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            continue;
+        }
+        ++served;
+        Viewer *added = &(clients[fd] = viewer);
+        if (!send_frame(fd, added)) drop(fd);
+    }
+}
+
+
+/*  refuse_viewer()
+ *  Purpose:  A helper function that accepts a waiting viewer and closes its
+ *            connection at once, using the spare file descriptor.
+ *  Returns:  False if there was no viewer to refuse, or no spare to do it
+ *            with.
+ */
+bool BroadcastServer::refuse_viewer(void)
+{
+    if (spare_fd < 0) return false;
+    close(spare_fd);
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd >= 0) {
+        close(fd);
+        ++refused;
+    }
+    spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+
+/*  send_frame()
+ *  Purpose:  A helper function that sends as much of a viewer's frame as
+ *            its socket will take.
+ *  Returns:  False if the viewer has gone.
+ *  Notes:  - If the socket is full, the socket is watched for room, and
+ *            service() calls this again once there is some.
+ */
+bool BroadcastServer::send_frame(int fd, Viewer *viewer)
+{
+    while (viewer->frame) {
+        string const &frame = *viewer->frame;
+        ssize_t written = send(fd, frame.data() + viewer->sent,
+                               frame.size() - viewer->sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        viewer->sent += written;
+        bytes += written;
+        if (viewer->sent == frame.size()) viewer->frame.reset();
+    }
+    bool blocked = (bool) viewer->frame;
+    if (blocked != viewer->blocked) {
+        viewer->blocked = blocked;
+        watch(fd, *viewer);
+    }
+    return true;
+}
+
+
+/*  drain_input()
+ *  Purpose:  A helper function that reads and throws away whatever a viewer
+ *            has sent, such as keys typed into the tool it connected with.
+ *  Returns:  False if the viewer has gone.
+ *  Notes:  - A viewer that closes its side for sending may still be
+ *            watching, so it is only no longer read from.
+ */
+bool BroadcastServer::drain_input(int fd, Viewer *viewer)
+{
+    char discard[4096];
+    for (;;) {
+        ssize_t got = read(fd, discard, sizeof(discard));
+        if (got > 0) continue;
+        if (got == 0) {
+            viewer->reading = false;
+            watch(fd, *viewer);
+            return true;
+        }
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+
+/*  watch()
+ *  Purpose:  A helper function that sets what epoll watches a viewer's
+ *            socket for: input while it is still sending, and room to send
+ *            while a frame is waiting.
+ */
+void BroadcastServer::watch(int fd, Viewer const &viewer)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = 0;
+    if (viewer.reading) event.events |= EPOLLIN;
+    if (viewer.blocked) event.events |= EPOLLOUT;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+
+/*  drop()
+ *  Purpose:  A helper function that disconnects a viewer.
+ */
+void BroadcastServer::drop(int fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    clients.erase(fd);
+}
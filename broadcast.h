@@ -0,0 +1,78 @@
+/*---------------------------------------------------------------------------*\
+ *  broadcast.h                                                              *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the BroadcastServer class, which sends the same animation to any *
+ *    number of viewers connected over a socket, so that it only has to be   *
+ *    drawn and encoded once however many terminals show it.                 *
+ *  The server listens on a Unix-domain socket, or on a TCP port.  Viewers   *
+ *    connect with any tool that copies a socket to a terminal, such as      *
+ *    "socat - UNIX-CONNECT:path" or "nc host port".                         *
+ *  Each tick, the caller hands broadcast() the frame's delta from the tick  *
+ *    before, and a keyframe, which shows the whole frame, when              *
+ *    wants_keyframe() says one is needed.  Both are shared between every    *
+ *    viewer, not copied.  A viewer that is up to date is sent the delta.    *
+ *    A viewer that is still being sent an earlier frame is sent nothing,    *
+ *    and once it catches up, it is sent the next keyframe instead of every  *
+ *    delta it missed.  So a slow viewer skips frames, and never holds more  *
+ *    than one frame in memory, while the rest keep up.                      *
+ *  Every socket is non-blocking and is watched by one epoll instance.  Its  *
+ *    file descriptor is ready to read whenever any socket needs attention,  *
+ *    so the caller can wait on it alongside its own deadline, and then      *
+ *    call service() to accept viewers, finish sending frames, and notice    *
+ *    viewers that have gone.                                                *
+ *  One file descriptor is kept spare.  If the process runs out, the spare   *
+ *    is used to accept a waiting viewer and turn it away at once, so the    *
+ *    listening socket does not stay ready with nothing able to take it.     *
+\*---------------------------------------------------------------------------*/
+#ifndef BROADCAST_H_
+#define BROADCAST_H_
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+class BroadcastServer
+{
+public:
+    BroadcastServer(void);
+    ~BroadcastServer(void);
+
+    bool listen(char const *address, std::string *error);
+    int get_fd(void) const;
+    void service(void);
+    bool wants_keyframe(void) const;
+    void broadcast(std::shared_ptr<std::string const> const &keyframe,
+                   std::shared_ptr<std::string const> const &delta);
+
+    unsigned viewers(void) const;
+    void print_stats(std::ostream &output) const;
+
+private:
+    struct Viewer
+    {
+        std::shared_ptr<std::string const> frame;   // Empty once it is sent
+        size_t sent;
+        bool stale;                     // Needs a keyframe to catch up
+        bool reading;                   // Until the viewer stops sending
+        bool blocked;                   // Waiting for room to send
+    };
+
+    BroadcastServer(BroadcastServer const &);
+    BroadcastServer &operator=(BroadcastServer const &);
+    void accept_viewers(void);
+    bool refuse_viewer(void);
+    bool send_frame(int fd, Viewer *viewer);
+    bool drain_input(int fd, Viewer *viewer);
+    void watch(int fd, Viewer const &viewer);
+    void drop(int fd);
+
+    int listen_fd, epoll_fd;
+    int spare_fd;                       // Given up to refuse a viewer
+    std::string socket_path;            // Removed when the server closes
+    std::shared_ptr<std::string const> clear_screen;
+    std::unordered_map<int, Viewer> clients;
+    unsigned long served, refused, frames, keyframes, skipped, bytes;
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*---------------------------------------------------------------------------*\
+ *  compositor.cpp                                                           *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the TileCompositor class.                        *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include "compositor.h"
+using namespace std;
+
+//  Tiles are wide and short, since each row of a tile is copied as a block.
+static const int TILE_HEIGHT = 16;
+static const int TILE_WIDTH = 128;
+
+
+/*  Constructor takes the pool of threads to draw with.
+ */
+TileCompositor::TileCompositor(ThreadPool *workers)
+{
+    pool = workers;
+    tile_rows = tile_cols = 0;
+}
+
+
+/*  draw_to()
+ *  Purpose:  Draws the current frame of every sprite onto the given image,
+ *            with exactly the same result as SpriteSystem::draw_to().
+ */
+void TileCompositor::draw_to(SpriteSystem const &sprites, Image<char> *board)
+{
+    draw_range(sprites, board, 0, sprites.size());
+}
+
+
+/*  draw_range()
+ *  Purpose:  Draws the current frames of sprites begin through end - 1 onto
+ *            the given image, with exactly the same result as
+ *            SpriteSystem::draw_range().
+ */
+void TileCompositor::draw_range(SpriteSystem const &sprites,
+                                Image<char> *board, unsigned begin,
+                                unsigned end)
+{
+    int board_height = board->get_height();
+    int board_width = board->get_width();
+    bin_sprites(sprites, begin, end, board_height, board_width);
+    pool->run(bins.size(), [&](unsigned tile) {
+        int top = (tile / tile_cols) * TILE_HEIGHT;
+        int left = (tile % tile_cols) * TILE_WIDTH;
+        Rect clip = { top, left, min(top + TILE_HEIGHT, board_height),
+                      min(left + TILE_WIDTH, board_width) };
+        vector<unsigned> const &bin = bins[tile];
+        for (unsigned i = 0; i < bin.size(); ++i) {
+            sprites.draw_one(bin[i], board, clip);
+        }
+    });
+}
+
+
+/*  bin_sprites()
+ *  Purpose:  A helper function that lists, for each tile, the sprites from
+ *            begin through end - 1 that overlap it, in drawing order.
+ *  Notes:  - A sprite on the edge of the world wraps, and is split into the
+ *            same pieces the drawing code uses; each piece is binned.
+ *          - With a viewport, sprites outside it are not binned at all.
+ *          - The bins keep their memory from frame to frame.
+ */
+void TileCompositor::bin_sprites(SpriteSystem const &sprites, unsigned begin,
+                                 unsigned end, unsigned board_height,
+                                 unsigned board_width)
+{
+    tile_rows = (board_height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    tile_cols = (board_width + TILE_WIDTH - 1) / TILE_WIDTH;
+    bins.resize(tile_rows * tile_cols);
+    for (unsigned t = 0; t < bins.size(); ++t) {
+        bins[t].clear();
+    }
+    Viewport view = sprites.get_viewport(board_height, board_width);
+    for (unsigned i = begin; i < end; ++i) {
+        unsigned row, col, height, width;
+        if (!sprites.is_visible(i, board_height, board_width) ||
+            !sprites.get_placement(i, &row, &col, &height, &width)) {
+            continue;
+        }
+        for_each_wrap(height, width, view.world_height, view.world_width, row,
+                      col, [&](int top, int left) {
+            top -= view.top;
+            left -= view.left;
+            int bottom = min(top + (int) height, (int) board_height);
+            int right = min(left + (int) width, (int) board_width);
+            top = max(top, 0);
+            left = max(left, 0);
+            if (top >= bottom || left >= right) return;
+            for (int r = top / TILE_HEIGHT; r <= (bottom - 1) / TILE_HEIGHT;
+                 ++r) {
+                for (int c = left / TILE_WIDTH; c <= (right - 1) / TILE_WIDTH;
+                     ++c) {
+                    vector<unsigned> &bin = bins[r * tile_cols + c];
+                    if (bin.empty() || bin.back() != i) bin.push_back(i);
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,39 @@
+/*---------------------------------------------------------------------------*\
+ *  compositor.h                                                             *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the TileCompositor class, which draws a SpriteSystem onto a      *
+ *    canvas using several threads.                                          *
+ *  The canvas is split into tiles.  Each sprite is first sorted into a      *
+ *    "bin" for every tile it overlaps, keeping the sprites' order.  Then    *
+ *    the tiles are handed to a ThreadPool, and each tile is drawn on its    *
+ *    own by drawing the sprites in its bin, clipped to the tile.  Since     *
+ *    every cell belongs to exactly one tile and sees its sprites in the     *
+ *    usual order, the result is the same as drawing serially.               *
+\*---------------------------------------------------------------------------*/
+#ifndef COMPOSITOR_H_
+#define COMPOSITOR_H_
+#include <vector>
+#include "image.h"
+#include "sprite_system.h"
+#include "thread_pool.h"
+
+class TileCompositor
+{
+public:
+    TileCompositor(ThreadPool *workers);
+
+    void draw_to(SpriteSystem const &sprites, Image<char> *board);
+    void draw_range(SpriteSystem const &sprites, Image<char> *board,
+                    unsigned begin, unsigned end);
+
+private:
+    void bin_sprites(SpriteSystem const &sprites, unsigned begin,
+                     unsigned end, unsigned board_height,
+                     unsigned board_width);
+    ThreadPool *pool;
+    unsigned tile_rows, tile_cols;
+    std::vector< std::vector<unsigned> > bins;
+};
+
+#endif
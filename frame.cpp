@@ -0,0 +1,264 @@
+/*---------------------------------------------------------------------------*\
+ *  frame.cpp                                                                *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the Frame class.                                 *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include <utility>
+#include "frame.h"
+using namespace std;
+
+
+/*  Default constructor makes an empty, opaque frame.
+ */
+Frame::Frame(void)
+{
+    transparent = false;
+    transparent_key = ' ';
+    opaque = true;
+    point_at_storage();
+}
+
+
+/*  Constructor for an opaque frame showing the given image.
+ */
+Frame::Frame(Image<char> img) : image(std::move(img))
+{
+    transparent = false;
+    transparent_key = ' ';
+    opaque = true;
+    point_at_storage();
+}
+
+
+/*  Constructor for a frame showing the given image, in which the key
+ *    character is transparent.
+ */
+Frame::Frame(Image<char> img, char key) : image(std::move(img))
+{
+    transparent = true;
+    transparent_key = key;
+    build_spans();
+    point_at_storage();
+}
+
+
+/*  Constructor for a frame that draws from memory it does not own.  The
+ *    owner is kept, and so the memory is too, for as long as the frame is.
+ */
+Frame::Frame(FrameData const &data, shared_ptr<void const> owner)
+    : backing(std::move(owner))
+{
+    pixels = data.pixels;
+    height = data.height;
+    width = data.width;
+    transparent = data.transparent;
+    transparent_key = data.key;
+    opaque = !data.transparent || data.opaque;
+    spans = opaque ? NULL : data.spans;
+    row_start = opaque ? NULL : data.row_start;
+}
+
+
+/*  Move constructor takes over the other frame's storage.
+ */
+Frame::Frame(Frame &&other)
+    : pixels(other.pixels), height(other.height), width(other.width),
+      spans(other.spans), row_start(other.row_start),
+      transparent(other.transparent), transparent_key(other.transparent_key),
+      opaque(other.opaque), image(std::move(other.image)),
+      span_store(std::move(other.span_store)),
+      row_store(std::move(other.row_store)),
+      backing(std::move(other.backing))
+{
+    if (!backing) point_at_storage();
+}
+
+
+/*  point_at_storage()
+ *  Purpose:  A helper function that sets up a frame that owns its data to
+ *            draw from that data.
+ */
+void Frame::point_at_storage(void)
+{
+    pixels = image.data();
+    height = image.get_height();
+    width = image.get_width();
+    spans = span_store.data();
+    row_start = row_store.data();
+}
+
+
+/*  build_spans()
+ *  Purpose:  Records the runs of non-key characters in each row.
+ *  Notes:  - If no character is the key, the frame is treated as opaque and
+ *            drawn with whole-row copies instead.
+ */
+void Frame::build_spans(void)
+{
+    unsigned height = image.get_height();
+    unsigned width = image.get_width();
+    unsigned visible = 0;
+    span_store.clear();
+    row_store.assign(1, 0);
+    for (unsigned row = 0; row < height; ++row) {
+        char const *cells = image.row_unchecked(row);
+        unsigned col = 0;
+        while (col < width) {
+            while (col < width && cells[col] == transparent_key) ++col;
+            if (col == width) break;
+            Span run = { col, 0 };
+            while (col < width && cells[col] != transparent_key) ++col;
+            run.length = col - run.col;
+            visible += run.length;
+            span_store.push_back(run);
+        }
+        row_store.push_back(span_store.size());
+    }
+    opaque = (visible == height * width);
+    if (opaque) {
+        span_store.clear();
+        row_store.clear();
+    }
+}
+
+
+/*  draw_to()
+ *  Purpose:  Draws the frame with its top-left corner at (row, col) in the
+ *            given image, wrapping around the edges as Image::update_at()
+ *            does.
+ */
+void Frame::draw_to(Image<char> *board, unsigned row, unsigned col) const
+{
+    draw_to(board, row, col, board->bounds());
+}
+
+
+/*  draw_to()
+ *  This version only changes cells inside the clip rectangle, so that
+ *    different parts of one image can be drawn separately.
+ */
+void Frame::draw_to(Image<char> *board, unsigned row, unsigned col,
+                    Rect const &clip) const
+{
+    for_each_wrap(get_height(), get_width(), board->get_height(),
+                  board->get_width(), row, col,
+                  [&](int top, int left) {
+                      draw_clipped(board, top, left, clip);
+                  });
+}
+
+
+/*  draw_clipped()
+ *  Purpose:  Draws the frame with its top-left corner at (row, col) in the
+ *            given image, changing only cells inside the clip rectangle.
+ *  Notes:  - No wrapping is done; the position may be negative.
+ *          - Opaque frames are copied a row at a time with Image::blit();
+ *            transparent ones copy only their spans.
+ */
+void Frame::draw_clipped(Image<char> *board, int row, int col,
+                         Rect const &clip) const
+{
+    if (opaque) {
+        board->blit(pixels, height, width, row, col, clip);
+        return;
+    }
+    int top = max(max(row, clip.top), 0);
+    int bottom = min(min(row + (int) get_height(), clip.bottom),
+                     (int) board->get_height());
+    int left = max(max(col, clip.left), 0);
+    int right = min(min(col + (int) get_width(), clip.right),
+                    (int) board->get_width());
+    for (int r = top; r < bottom; ++r) {
+        char const *source = pixels + (size_t) (r - row) * width;
+        char *dest = board->row_unchecked(r);
+        unsigned end = row_start[r - row + 1];
+        for (unsigned s = row_start[r - row]; s < end; ++s) {
+            int start = max(col + (int) spans[s].col, left);
+            int stop = min(col + (int) (spans[s].col + spans[s].length),
+                           right);
+            if (start < stop) {
+                copy(source + (start - col), source + (stop - col),
+                     dest + start);
+            }
+        }
+    }
+}
+
+
+/*  to_image()
+ *  Purpose:  Returns a copy of the frame's picture, including transparent
+ *            characters.
+ */
+Image<char> Frame::to_image(void) const
+{
+    Image<char> copy(height, width);
+    std::copy(pixels, pixels + (size_t) height * width, copy.data());
+    return copy;
+}
+
+
+/*  row()
+ *  Purpose:  Returns a pointer to the first character of row r of the
+ *            picture, which must be in bounds.  The row's get_width()
+ *            characters follow contiguously.
+ */
+char const *Frame::row(unsigned r) const
+{
+    return pixels + (size_t) r * width;
+}
+
+
+/*  get_spans(), get_row_starts()
+ *  Purpose:  Return the spans of a frame that is not opaque, and where each
+ *            row's spans start, laid out as described for FrameData.
+ *  Notes:  - Neither means anything for an opaque frame.
+ */
+Span const *Frame::get_spans(void) const
+{
+    return spans;
+}
+
+unsigned const *Frame::get_row_starts(void) const
+{
+    return row_start;
+}
+
+
+/*  has_key(), get_key()
+ *  Purpose:  Return whether the frame has a transparent key character, and
+ *            what it is.
+ */
+bool Frame::has_key(void) const
+{
+    return transparent;
+}
+
+char Frame::get_key(void) const
+{
+    return transparent_key;
+}
+
+
+/*  is_opaque()
+ *  Purpose:  Returns whether every character of the frame is drawn.
+ */
+bool Frame::is_opaque(void) const
+{
+    return opaque;
+}
+
+
+/*  get_height(), get_width()
+ *  Purpose:  Return the size of the frame.
+ */
+unsigned Frame::get_height(void) const
+{
+    return height;
+}
+
+unsigned Frame::get_width(void) const
+{
+    return width;
+}
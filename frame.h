@@ -0,0 +1,96 @@
+/*---------------------------------------------------------------------------*\
+ *  frame.h                                                                  *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the Frame class, which is one image in a Sprite's animation      *
+ *    cycle, prepared for drawing.                                           *
+ *  A Frame may be opaque, in which case every character is drawn, or it may *
+ *    have a transparent "key" character, which is never drawn and lets      *
+ *    whatever is underneath show through.  For a transparent Frame, each    *
+ *    row is stored as a list of spans: the runs of characters that are not  *
+ *    the key.  Drawing copies only those runs, so blank space costs nothing.*
+ *  A Frame normally owns its picture and spans.  It can instead draw from   *
+ *    ones already laid out somewhere else in memory, such as a mapped scene *
+ *    file, described by a FrameData.  The Frame then keeps a shared pointer *
+ *    to whatever holds that memory, so it stays valid while the Frame does. *
+\*---------------------------------------------------------------------------*/
+#ifndef FRAME_H_
+#define FRAME_H_
+#include <memory>
+#include <vector>
+#include "image.h"
+
+/*  A run of visible characters in one row of a Frame.
+ */
+struct Span
+{
+    unsigned col, length;
+};
+
+
+/*  A frame laid out in memory the Frame does not own.  The picture is
+ *    height rows of width characters, one right after another.  If the frame
+ *    is transparent and not opaque, there are height + 1 row starts, and
+ *    row r's spans are spans[row_start[r]] up to spans[row_start[r + 1]].
+ */
+struct FrameData
+{
+    char const *pixels;
+    unsigned height, width;
+    bool transparent;
+    char key;
+    bool opaque;
+    Span const *spans;
+    unsigned const *row_start;
+};
+
+
+class Frame
+{
+public:
+    Frame(void);
+    Frame(Image<char> img);
+    Frame(Image<char> img, char key);
+    Frame(FrameData const &data, std::shared_ptr<void const> owner);
+    Frame(Frame &&other);
+
+    void draw_to(Image<char> *board, unsigned row, unsigned col) const;
+    void draw_to(Image<char> *board, unsigned row, unsigned col,
+                 Rect const &clip) const;
+    void draw_clipped(Image<char> *board, int row, int col,
+                      Rect const &clip) const;
+
+    Image<char> to_image(void) const;
+    char const *row(unsigned r) const;
+    Span const *get_spans(void) const;
+    unsigned const *get_row_starts(void) const;
+    bool has_key(void) const;
+    char get_key(void) const;
+    bool is_opaque(void) const;
+    unsigned get_height(void) const;
+    unsigned get_width(void) const;
+
+private:
+    Frame(Frame const &);
+    Frame &operator=(Frame const &);
+    void build_spans(void);
+    void point_at_storage(void);
+
+    //  What is drawn from, whether owned or not.
+    char const *pixels;
+    unsigned height, width;
+    Span const *spans;
+    unsigned const *row_start;
+    bool transparent;
+    char transparent_key;
+    bool opaque;
+
+    //  The storage of a frame that owns its data, or what keeps the memory
+    //    of one that does not alive.
+    Image<char> image;
+    std::vector<Span> span_store;
+    std::vector<unsigned> row_store;
+    std::shared_ptr<void const> backing;
+};
+
+#endif
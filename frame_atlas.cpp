@@ -0,0 +1,87 @@
+/*---------------------------------------------------------------------------*\
+ *  frame_atlas.cpp                                                          *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the FrameAtlas class.                            *
+\*---------------------------------------------------------------------------*/
+#include <cstring>
+#include "frame_atlas.h"
+using namespace std;
+
+static const size_t FNV_OFFSET = 14695981039346656037ULL;
+static const size_t FNV_PRIME = 1099511628211ULL;
+
+
+/*  intern()
+ *  Purpose:  Returns a handle to a frame identical to the given one, adding
+ *            the given frame to the atlas if there was none.
+ */
+FrameHandle FrameAtlas::intern(Frame &&frame)
+{
+    size_t key = hash(frame);
+    lock_guard<mutex> guard(lock);
+    auto matches = frames.equal_range(key);
+    for (auto it = matches.first; it != matches.second; ++it) {
+        if (same(*it->second, frame)) return it->second;
+    }
+    FrameHandle handle = make_shared<Frame const>(std::move(frame));
+    frames.insert(make_pair(key, handle));
+    return handle;
+}
+
+
+/*  size()
+ *  Purpose:  Returns the number of distinct frames in the atlas.
+ */
+unsigned FrameAtlas::size(void) const
+{
+    lock_guard<mutex> guard(lock);
+    return frames.size();
+}
+
+
+/*  hash()
+ *  Purpose:  A helper function that hashes everything that affects how a
+ *            frame is drawn: its size, its transparent key and its picture.
+ *  Notes:  - Uses 64-bit FNV-1a.
+ */
+size_t FrameAtlas::hash(Frame const &frame)
+{
+    unsigned height = frame.get_height();
+    unsigned width = frame.get_width();
+    unsigned header[3] = { height, width,
+                           frame.has_key() ? 256u + (unsigned char)
+                                                 frame.get_key() : 0u };
+    size_t value = FNV_OFFSET;
+    unsigned char const *bytes = (unsigned char const *) header;
+    for (unsigned i = 0; i < sizeof(header); ++i) {
+        value = (value ^ bytes[i]) * FNV_PRIME;
+    }
+    for (unsigned r = 0; r < height; ++r) {
+        bytes = (unsigned char const *) frame.row(r);
+        for (unsigned i = 0; i < width; ++i) {
+            value = (value ^ bytes[i]) * FNV_PRIME;
+        }
+    }
+    return value;
+}
+
+
+/*  same()
+ *  Purpose:  A helper function that checks whether two frames would draw
+ *            identically.
+ */
+bool FrameAtlas::same(Frame const &a, Frame const &b)
+{
+    unsigned height = a.get_height();
+    unsigned width = a.get_width();
+    if (height != b.get_height() || width != b.get_width() ||
+        a.has_key() != b.has_key() ||
+        (a.has_key() && a.get_key() != b.get_key())) {
+        return false;
+    }
+    for (unsigned r = 0; r < height; ++r) {
+        if (memcmp(a.row(r), b.row(r), width) != 0) return false;
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+/*---------------------------------------------------------------------------*\
+ *  frame_atlas.h                                                            *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the FrameAtlas class, which makes sure each distinct frame is    *
+ *    stored only once, no matter how many sprites use it.                   *
+ *  Frames are handed out as FrameHandles, which are shared pointers to      *
+ *    frames that can no longer change.  Copying a handle, and so copying a  *
+ *    Sprite, never copies the frame itself.  A frame stays alive as long as *
+ *    some handle to it does, even if the atlas is gone.                     *
+ *  When a frame is added with intern(), the atlas looks for an identical    *
+ *    frame by a hash of its contents, and returns a handle to that one if   *
+ *    it finds it.  intern() may be called from several threads at once.     *
+\*---------------------------------------------------------------------------*/
+#ifndef FRAME_ATLAS_H_
+#define FRAME_ATLAS_H_
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "frame.h"
+
+typedef std::shared_ptr<Frame const> FrameHandle;
+
+class FrameAtlas
+{
+public:
+    FrameHandle intern(Frame &&frame);
+    unsigned size(void) const;
+
+private:
+    static size_t hash(Frame const &frame);
+    static bool same(Frame const &a, Frame const &b);
+    mutable std::mutex lock;
+    std::unordered_multimap<size_t, FrameHandle> frames;
+};
+
+#endif
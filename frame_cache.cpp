@@ -0,0 +1,305 @@
+/*---------------------------------------------------------------------------*\
+ *  frame_cache.cpp                                                          *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the FrameCache class.                            *
+\*---------------------------------------------------------------------------*/
+#include <cerrno>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include "frame_cache.h"
+#include "scene_parser.h"
+using namespace std;
+
+//  The capacity of a cache nobody has set one for.
+static const size_t DEFAULT_CAPACITY = 64 << 20;
+
+//  At most this many frames wait to be prefetched.  Asking for more while
+//    the queue is full does nothing, since the thread is already behind.
+static const unsigned MAX_PENDING = 1024;
+
+
+/*  Default constructor makes an empty cache.  No thread is started until
+ *    something is prefetched.
+ */
+FrameCache::FrameCache(void)
+{
+    capacity = DEFAULT_CAPACITY;
+    held = 0;
+    stopping = false;
+    hits = misses = prefetched = evicted = 0;
+}
+
+
+/*  Destructor stops the prefetching thread, if there is one, and closes the
+ *    files.
+ */
+FrameCache::~FrameCache(void)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (loader.joinable()) loader.join();
+    for (unsigned f = 0; f < files.size(); ++f) {
+        if (files[f].fd >= 0) close(files[f].fd);
+    }
+}
+
+
+/*  add_file()
+ *  Purpose:  Adds a file that frames can be indexed in.
+ *  Returns:  The number to pass to add_frame() for frames in that file.
+ *  Notes:  - The file is not opened until a frame is first read from it.
+ */
+unsigned FrameCache::add_file(string const &name)
+{
+    lock_guard<mutex> guard(lock);
+    File file = { name, -1 };
+    files.push_back(file);
+    return files.size() - 1;
+}
+
+
+/*  add_frame()
+ *  Purpose:  Indexes one frame, without reading it.
+ *  Parameters: The number of the file it is in, from add_file().  Where its
+ *            first row starts in the file, and how many bytes its rows take
+ *            up, newlines included.  Its size, and its transparent key if it
+ *            has one.
+ *  Returns:  The number to pass to get() and prefetch() for the frame.
+ *  Notes:  - The rows are read as SceneParser::read_rows() reads them.
+ */
+unsigned FrameCache::add_frame(unsigned file, uint64_t offset,
+                               uint64_t length, unsigned height,
+                               unsigned width, bool transparent, char key)
+{
+    lock_guard<mutex> guard(lock);
+    Entry entry;
+    entry.where.file = file;
+    entry.where.offset = offset;
+    entry.where.length = length;
+    entry.where.height = height;
+    entry.where.width = width;
+    entry.where.transparent = transparent;
+    entry.where.key = key;
+    entry.queued = false;
+    entries.push_back(std::move(entry));
+    return entries.size() - 1;
+}
+
+
+/*  get()
+ *  Purpose:  Returns the given frame, reading it from its file if it is not
+ *            held already.
+ *  Notes:  - The file is read without the lock held, so other threads can
+ *            use the cache meanwhile.  If two threads read the same frame at
+ *            once, both get the copy that was kept first.
+ */
+FrameHandle FrameCache::get(unsigned frame)
+{
+    unique_lock<mutex> guard(lock);
+    Entry &entry = entries[frame];
+    if (entry.frame) {
+        ++hits;
+        recent.splice(recent.begin(), recent, entry.use);
+        return entry.frame;
+    }
+    ++misses;
+    Location where = entry.where;
+    int fd = open_file(where.file);
+    guard.unlock();
+    FrameHandle loaded = load(where, fd);
+    guard.lock();
+    return keep(frame, std::move(loaded));
+}
+
+
+/*  prefetch()
+ *  Purpose:  Asks for the given frames to be read in the background, if
+ *            they are not held already.
+ */
+void FrameCache::prefetch(vector<unsigned> const &frames)
+{
+    bool added = false;
+    {
+        lock_guard<mutex> guard(lock);
+        for (unsigned i = 0; i < frames.size(); ++i) {
+            Entry &entry = entries[frames[i]];
+            if (entry.frame || entry.queued) continue;
+            if (pending.size() >= MAX_PENDING) break;
+            entry.queued = true;
+            pending.push_back(frames[i]);
+            added = true;
+        }
+        if (added && !loader.joinable()) {
+            loader = thread(&FrameCache::prefetch_loop, this);
+        }
+    }
+    if (added) wake.notify_one();
+}
+
+
+/*  set_capacity()
+ *  Purpose:  Sets how many bytes of frames the cache may hold, dropping the
+ *            least recently used frames if it now holds too many.
+ */
+void FrameCache::set_capacity(size_t bytes)
+{
+    lock_guard<mutex> guard(lock);
+    capacity = bytes;
+    trim();
+}
+
+
+/*  size()
+ *  Purpose:  Returns the number of frames indexed.
+ */
+unsigned FrameCache::size(void) const
+{
+    lock_guard<mutex> guard(lock);
+    return entries.size();
+}
+
+
+/*  print_stats()
+ *  Purpose:  Prints how often frames were found in the cache, how many were
+ *            read and dropped, and how much is held, on one line.
+ */
+void FrameCache::print_stats(ostream &output) const
+{
+    lock_guard<mutex> guard(lock);
+    output << "frame cache hits: " << hits
+           << "  misses: " << misses
+           << "  prefetched: " << prefetched
+           << "  evicted: " << evicted
+           << "  held: " << recent.size() << " frames, "
+           << held / 1024 << " of " << capacity / 1024 << " KiB" << endl;
+}
+
+
+/*  open_file()
+ *  Purpose:  A helper function that returns the descriptor of the given
+ *            file, opening it if this is the first time it is read.
+ *  Returns:  -1 if the file could not be opened.
+ *  Notes:  - Must be called with the lock held.
+ */
+int FrameCache::open_file(unsigned file)
+{
+    if (files[file].fd < 0) {
+        files[file].fd = open(files[file].name.c_str(), O_RDONLY);
+    }
+    return files[file].fd;
+}
+
+
+/*  load()
+ *  Purpose:  A helper function that reads a frame from its file.
+ *  Notes:  - Anything that cannot be read is left blank, as a row that is
+ *            too short in the file would be.
+ */
+FrameHandle FrameCache::load(Location const &where, int fd)
+{
+    string text(where.length, '\0');
+    size_t done = 0;
+    while (fd >= 0 && done < text.size()) {
+        ssize_t got = pread(fd, &text[done], text.size() - done,
+                            where.offset + done);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        done += got;
+    }
+    text.resize(done);
+    Image<char> image(where.height, where.width);
+    image.set_all(' ');
+    SceneParser rows(text);
+    rows.read_rows(&image);
+    if (where.transparent) {
+        return make_shared<Frame const>(std::move(image), where.key);
+    }
+    return make_shared<Frame const>(std::move(image));
+}
+
+
+/*  keep()
+ *  Purpose:  A helper function that holds a frame just read, as the most
+ *            recently used, then trims the cache.
+ *  Returns:  The frame held, which is an earlier copy if another thread
+ *            kept one first.
+ *  Notes:  - Must be called with the lock held.
+ */
+FrameHandle FrameCache::keep(unsigned frame, FrameHandle loaded)
+{
+    Entry &entry = entries[frame];
+    if (!entry.frame) {
+        entry.frame = std::move(loaded);
+        recent.push_front(frame);
+        entry.use = recent.begin();
+        held += memory_used(*entry.frame);
+        trim();
+    }
+    return entry.frame;
+}
+
+
+/*  trim()
+ *  Purpose:  A helper function that drops the least recently used frames
+ *            until the cache holds no more than its capacity.
+ *  Notes:  - The most recently used frame is always kept, however large.
+ *          - Must be called with the lock held.
+ */
+void FrameCache::trim(void)
+{
+    while (held > capacity && recent.size() > 1) {
+        Entry &oldest = entries[recent.back()];
+        held -= memory_used(*oldest.frame);
+        oldest.frame.reset();
+        recent.pop_back();
+        ++evicted;
+    }
+}
+
+
+/*  prefetch_loop()
+ *  Purpose:  The body of the prefetching thread: reads each frame asked for,
+ *            in order, until the cache is destroyed.
+ */
+void FrameCache::prefetch_loop(void)
+{
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [this] { return stopping || !pending.empty(); });
+        if (stopping) return;
+        unsigned frame = pending.front();
+        pending.pop_front();
+        Entry &entry = entries[frame];
+        entry.queued = false;
+        if (entry.frame) continue;
+        Location where = entry.where;
+        int fd = open_file(where.file);
+        guard.unlock();
+        FrameHandle loaded = load(where, fd);
+        guard.lock();
+        keep(frame, std::move(loaded));
+        ++prefetched;
+    }
+}
+
+
+/*  memory_used()
+ *  Purpose:  A helper function that estimates the bytes a frame takes: its
+ *            picture, its spans, and the Frame itself.
+ */
+size_t FrameCache::memory_used(Frame const &frame)
+{
+    size_t bytes = sizeof(Frame) +
+                   (size_t) frame.get_height() * frame.get_width();
+    unsigned const *row_start = frame.get_row_starts();
+    if (row_start != NULL) {
+        bytes += (frame.get_height() + 1) * sizeof(unsigned) +
+                 row_start[frame.get_height()] * sizeof(Span);
+    }
+    return bytes;
+}
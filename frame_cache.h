@@ -0,0 +1,98 @@
+/*---------------------------------------------------------------------------*\
+ *  frame_cache.h                                                            *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the FrameCache class, which lets sprites with very many frames   *
+ *    be animated without holding all of them in memory.                     *
+ *  Instead of being read, a frame is indexed: the cache records which file  *
+ *    it is in, where its rows start and how many bytes they take, and       *
+ *    hands back a number for it.  get() reads the frame from its file the   *
+ *    first time it is needed, and keeps it until the frames held would take *
+ *    more memory than the cache's capacity.  Then the frames used least     *
+ *    recently are dropped, to be read again if they are needed again.       *
+ *  prefetch() asks for frames that will be needed soon.  They are read on a *
+ *    thread of the cache's own, which is only started once something is     *
+ *    prefetched, so that drawing them later does not wait on the file.      *
+ *  Frames are handed out as FrameHandles, so a frame dropped from the cache *
+ *    while it is being drawn stays alive until the drawing is done.  Every  *
+ *    method may be called from several threads at once.                     *
+\*---------------------------------------------------------------------------*/
+#ifndef FRAME_CACHE_H_
+#define FRAME_CACHE_H_
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame.h"
+#include "frame_atlas.h"
+
+class FrameCache
+{
+public:
+    FrameCache(void);
+    ~FrameCache(void);
+
+    unsigned add_file(std::string const &name);
+    unsigned add_frame(unsigned file, uint64_t offset, uint64_t length,
+                       unsigned height, unsigned width, bool transparent,
+                       char key);
+    FrameHandle get(unsigned frame);
+    void prefetch(std::vector<unsigned> const &frames);
+
+    void set_capacity(size_t bytes);
+    unsigned size(void) const;
+    void print_stats(std::ostream &output) const;
+
+private:
+    //  Where an indexed frame is, and what it looks like.
+    struct Location
+    {
+        unsigned file;
+        uint64_t offset, length;
+        unsigned height, width;
+        bool transparent;
+        char key;
+    };
+
+    struct Entry
+    {
+        Location where;
+        FrameHandle frame;                  // Empty unless it is held
+        std::list<unsigned>::iterator use;  // Its place in recent, if held
+        bool queued;                        // Waiting to be prefetched
+    };
+
+    struct File
+    {
+        std::string name;
+        int fd;                             // -1 until it is first read
+    };
+
+    FrameCache(FrameCache const &);
+    FrameCache &operator=(FrameCache const &);
+    int open_file(unsigned file);
+    static FrameHandle load(Location const &where, int fd);
+    FrameHandle keep(unsigned frame, FrameHandle loaded);
+    void trim(void);
+    void prefetch_loop(void);
+    static size_t memory_used(Frame const &frame);
+
+    mutable std::mutex lock;
+    std::vector<File> files;
+    std::vector<Entry> entries;
+    std::list<unsigned> recent;             // Held frames, most recent first
+    size_t capacity, held;
+    std::deque<unsigned> pending;
+    std::condition_variable wake;
+    std::thread loader;
+    bool stopping;
+    unsigned long hits, misses, prefetched, evicted;
+};
+
+#endif
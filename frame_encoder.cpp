@@ -0,0 +1,286 @@
+/*---------------------------------------------------------------------------*\
+ *  frame_encoder.cpp                                                        *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the FrameEncoder class.                          *
+\*---------------------------------------------------------------------------*/
+#include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "frame_encoder.h"
+using namespace std;
+
+static const char HOME[] = "\033[H";
+
+//  Unchanged cells shorter than this between two changed ones are resent
+//    rather than skipped, since a cursor movement would cost more bytes.
+static const unsigned MERGE_GAP = 8;
+
+
+/*  Constructor takes the file descriptor frames will be written to, which
+ *    defaults to standard output.
+ */
+FrameEncoder::FrameEncoder(int out_fd)
+{
+    fd = out_fd;
+    frames = bytes = syscalls = 0;
+}
+
+
+/*  present()
+ *  Purpose:  Encodes the given frame in full and writes it out.
+ */
+void FrameEncoder::present(Image<char> const &frame)
+{
+    begin_frame();
+    encode_full(frame);
+    flush();
+}
+
+
+/*  begin_frame()
+ *  Purpose:  Empties the buffer, ready to encode a new frame.
+ *  Notes:  - Clearing a string keeps its capacity, so the buffer only
+ *            allocates while it is growing to the size of the largest frame.
+ */
+void FrameEncoder::begin_frame(void)
+{
+    buffer.clear();
+}
+
+
+/*  encode_full()
+ *  Purpose:  Appends the sequence that moves the cursor to the top of the
+ *            screen, then every row of the given frame, each followed by a
+ *            newline.
+ */
+void FrameEncoder::encode_full(Image<char> const &frame)
+{
+    buffer.append(HOME, sizeof(HOME) - 1);
+    encode_plain(frame);
+}
+
+
+/*  encode_plain()
+ *  Purpose:  Appends every row of the given frame, each followed by a
+ *            newline, with no control sequences at all.
+ */
+void FrameEncoder::encode_plain(Image<char> const &frame)
+{
+    unsigned height = frame.get_height();
+    unsigned width = frame.get_width();
+    buffer.reserve(buffer.size() + height * (width + 1));
+    for (unsigned row = 0; row < height; ++row) {
+        buffer.append(frame.row_unchecked(row), width);
+        buffer.push_back('\n');
+    }
+}
+
+
+/*  encode_diff()
+ *  Purpose:  Appends what is needed to turn a screen showing prev into one
+ *            showing next: for each run of changed cells, a cursor movement
+ *            and the new characters.
+ *  Notes:  - Both frames must be the same size.
+ *          - Rows are compared whole first, so unchanged rows cost only a
+ *            memcmp.
+ *          - Runs separated by fewer than MERGE_GAP unchanged cells are
+ *            joined, and no cursor movement is sent when the cursor is
+ *            already where the next run starts.
+ */
+void FrameEncoder::encode_diff(Image<char> const &prev,
+                               Image<char> const &next)
+{
+    unsigned height = next.get_height();
+    unsigned width = next.get_width();
+    unsigned cursor_row = height, cursor_col = width;   // Unknown position
+    for (unsigned row = 0; row < height; ++row) {
+        char const *old_cells = prev.row_unchecked(row);
+        char const *new_cells = next.row_unchecked(row);
+        if (memcmp(old_cells, new_cells, width) == 0) continue;
+        unsigned col = 0;
+        while (col < width) {
+            while (col < width && old_cells[col] == new_cells[col]) ++col;
+            if (col == width) break;
+            unsigned start = col, last_changed = col;
+            for (++col; col < width; ++col) {
+                if (old_cells[col] != new_cells[col]) {
+                    last_changed = col;
+                } else if (col - last_changed >= MERGE_GAP) {
+                    break;
+                }
+            }
+            if (row != cursor_row || start != cursor_col) {
+                place_cursor(row, start);
+            }
+            buffer.append(new_cells + start, last_changed + 1 - start);
+            cursor_row = row;
+            cursor_col = last_changed + 1;
+            col = cursor_col;
+        }
+    }
+}
+
+
+/*  place_cursor()
+ *  Purpose:  Appends the sequence that moves the cursor to the given row and
+ *            column, both 0-based.
+ */
+void FrameEncoder::place_cursor(unsigned row, unsigned col)
+{
+    char sequence[32];
+    int length = snprintf(sequence, sizeof(sequence), "\033[%u;%uH",
+                          row + 1, col + 1);
+    buffer.append(sequence, length);
+}
+
+
+/*  flush()
+ *  Purpose:  Writes the buffer to the file descriptor.
+ *  Returns:  True if everything was written, false on an error.
+ *  Notes:  - Normally this is a single write(); it only loops if the kernel
+ *            accepts part of the buffer or the call is interrupted.
+ *          - Anything still waiting in cout should be flushed before the
+ *            first frame, since this bypasses it.
+ */
+bool FrameEncoder::flush(void)
+{
+    return send(buffer.data(), buffer.size());
+}
+
+
+/*  send()
+ *  Purpose:  Writes the given bytes, which make up one frame, to the file
+ *            descriptor, bypassing the buffer.
+ *  Returns:  True if everything was written, false on an error.
+ *  Notes:  - Counted in the totals just as a frame written by flush() is,
+ *            so frames encoded ahead of time can be sent with it.
+ */
+bool FrameEncoder::send(char const *data, size_t size)
+{
+    char const *next = data;
+    size_t remaining = size;
+    while (remaining > 0) {
+        ssize_t written = write(fd, next, remaining);
+        ++syscalls;
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        next += written;
+        remaining -= written;
+        bytes += written;
+    }
+    ++frames;
+    return true;
+}
+
+
+/*  get_buffered()
+ *  Purpose:  Returns the number of bytes encoded but not yet written.
+ */
+size_t FrameEncoder::get_buffered(void) const
+{
+    return buffer.size();
+}
+
+
+/*  get_buffer()
+ *  Purpose:  Returns what has been encoded but not yet written.
+ */
+string const &FrameEncoder::get_buffer(void) const
+{
+    return buffer;
+}
+
+
+/*  get_frames(), get_bytes(), get_syscalls()
+ *  Purpose:  Return the totals since the encoder was created.
+ */
+unsigned long FrameEncoder::get_frames(void) const
+{
+    return frames;
+}
+
+unsigned long FrameEncoder::get_bytes(void) const
+{
+    return bytes;
+}
+
+unsigned long FrameEncoder::get_syscalls(void) const
+{
+    return syscalls;
+}
+
+
+/*  print_stats()
+ *  Purpose:  Prints the totals and the per-frame averages on one line.
+ */
+void FrameEncoder::print_stats(ostream &output) const
+{
+    double per_frame = (frames == 0) ? 0 : 1.0 / frames;
+    output << "frames: " << frames
+           << "  bytes/frame: " << bytes * per_frame
+           << "  syscalls/frame: " << syscalls * per_frame << endl;
+}
+
+
+/*  Constructor takes the encoder to send frames through.  Nothing is known
+ *    to be on screen yet, so the first frame is sent in full.
+ */
+DiffRenderer::DiffRenderer(FrameEncoder *enc)
+{
+    encoder = enc;
+    front_valid = false;
+}
+
+
+/*  present()
+ *  Purpose:  Brings the screen up to date with the given frame, sending only
+ *            the cells that differ from the frame shown before it.
+ *  Notes:  - The whole frame is sent instead when nothing is known about the
+ *            screen, when the frame size has changed, or when the difference
+ *            would take more bytes than the frame itself.
+ *          - Nothing at all is written if the frame has not changed.
+ */
+void DiffRenderer::present(Image<char> const &back)
+{
+    encode(back);
+    encoder->flush();
+}
+
+
+/*  encode()
+ *  Purpose:  Does everything present() does except the writing: leaves what
+ *            the screen needs in the encoder, for the caller to flush().
+ */
+void DiffRenderer::encode(Image<char> const &back)
+{
+    unsigned height = back.get_height();
+    unsigned width = back.get_width();
+    encoder->begin_frame();
+    if (front_valid && front.get_height() == height &&
+        front.get_width() == width) {
+        encoder->encode_diff(front, back);
+        if (encoder->get_buffered() > height * (width + 1)) {
+            encoder->begin_frame();
+            encoder->encode_full(back);
+        }
+    } else {
+        encoder->encode_full(back);
+    }
+    front = back;
+    front_valid = true;
+}
+
+
+/*  invalidate()
+ *  Purpose:  Forgets what is on screen, so the next frame is sent in full.
+ *            Use this whenever something else may have drawn on the terminal.
+ */
+void DiffRenderer::invalidate(void)
+{
+    front_valid = false;
+}
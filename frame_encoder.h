@@ -0,0 +1,68 @@
+/*---------------------------------------------------------------------------*\
+ *  frame_encoder.h                                                          *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the FrameEncoder class, which turns a whole canvas into the      *
+ *    bytes needed to show it on a terminal and sends them with a single     *
+ *    write() to a file descriptor.                                          *
+ *  The byte buffer is kept between frames, so once it has grown to the size *
+ *    of a frame, encoding does no further allocation.  The encoder also     *
+ *    counts the frames, bytes and system calls it has sent, so the cost of  *
+ *    output can be measured.                                                *
+ *  Besides whole frames, the encoder can encode just the difference between *
+ *    two frames, as cursor movements followed by the runs of characters     *
+ *    that changed.  The DiffRenderer class uses this to keep a terminal up  *
+ *    to date: it remembers the frame currently on screen (the front buffer) *
+ *    and sends only what differs in each new frame (the back buffer).       *
+\*---------------------------------------------------------------------------*/
+#ifndef FRAME_ENCODER_H_
+#define FRAME_ENCODER_H_
+#include <string>
+#include <ostream>
+#include "image.h"
+
+class FrameEncoder
+{
+public:
+    FrameEncoder(int out_fd = 1);
+
+    void present(Image<char> const &frame);
+
+    void begin_frame(void);
+    void encode_full(Image<char> const &frame);
+    void encode_plain(Image<char> const &frame);
+    void encode_diff(Image<char> const &prev, Image<char> const &next);
+    void place_cursor(unsigned row, unsigned col);
+    bool flush(void);
+    bool send(char const *data, size_t size);
+    size_t get_buffered(void) const;
+    std::string const &get_buffer(void) const;
+
+    unsigned long get_frames(void) const;
+    unsigned long get_bytes(void) const;
+    unsigned long get_syscalls(void) const;
+    void print_stats(std::ostream &output) const;
+
+private:
+    int fd;
+    std::string buffer;
+    unsigned long frames, bytes, syscalls;
+};
+
+
+class DiffRenderer
+{
+public:
+    DiffRenderer(FrameEncoder *enc);
+
+    void present(Image<char> const &back);
+    void encode(Image<char> const &back);
+    void invalidate(void);
+
+private:
+    FrameEncoder *encoder;
+    Image<char> front;
+    bool front_valid;
+};
+
+#endif
@@ -0,0 +1,122 @@
+/*---------------------------------------------------------------------------*\
+ *  frame_loop.cpp                                                           *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the FrameLoop class.                             *
+\*---------------------------------------------------------------------------*/
+#include <iostream>
+#include "frame_loop.h"
+#include "frame_encoder.h"
+#include "scheduler.h"
+using namespace std;
+
+
+/*  Default constructor makes an empty loop.
+ */
+FrameLoop::FrameLoop(void)
+{
+    period = 0;
+    build_time = 0;
+}
+
+
+/*  build()
+ *  Purpose:  Finds the period of the given sprites, and if it is short
+ *            enough, encodes every tick of one cycle.
+ *  Parameters: The sprites, and the layer cache and compositor to draw them
+ *            with, as the animation would (the compositor may be NULL).  A
+ *            pointer to a canvas to draw on, which will be modified.  The
+ *            longest period to accept, in ticks.  How to encode the frames.
+ *  Returns:  False, leaving the loop empty, if there is no period of at most
+ *            limit ticks.
+ *  Notes:  - The sprites are given the period with set_period(), so that if
+ *            they are drawn again later, each tick looks just as it does in
+ *            the loop.  They are left at the tick they were at.
+ *          - Takes as long as drawing the whole cycle, and as much memory as
+ *            the cycle's encoded frames.
+ */
+bool FrameLoop::build(SpriteSystem *sprites, LayerCache *layers,
+                      TileCompositor *compositor, Image<char> *canvas,
+                      unsigned long limit, Encoding how)
+{
+    long long start = FrameScheduler::now();
+    bytes.clear();
+    starts.clear();
+    period = sprites->find_period(canvas->get_height(), canvas->get_width(),
+                                  limit);
+    if (period == 0) return false;
+    unsigned long resume = sprites->get_tick();
+    sprites->set_period(period);
+    FrameEncoder encoder(-1);
+    DiffRenderer renderer(&encoder);
+    if (how == DIFF) {
+        sprites->seek(period - 1, canvas->get_height(), canvas->get_width());
+        layers->draw_to(*sprites, canvas, compositor);
+        renderer.encode(*canvas);
+    }
+    for (unsigned long tick = 0; tick < period; ++tick) {
+        sprites->seek(tick, canvas->get_height(), canvas->get_width());
+        layers->draw_to(*sprites, canvas, compositor);
+        if (how == DIFF) {
+            renderer.encode(*canvas);
+        } else {
+            encoder.begin_frame();
+            if (how == FULL) {
+                encoder.encode_full(*canvas);
+            } else {
+                encoder.encode_plain(*canvas);
+            }
+        }
+        starts.push_back(bytes.size());
+        bytes += encoder.get_buffer();
+    }
+    starts.push_back(bytes.size());
+    sprites->seek(resume, canvas->get_height(), canvas->get_width());
+    build_time = FrameScheduler::now() - start;
+    return true;
+}
+
+
+/*  empty()
+ *  Purpose:  Returns whether the loop holds no frames.
+ */
+bool FrameLoop::empty(void) const
+{
+    return starts.empty();
+}
+
+
+/*  get_period()
+ *  Purpose:  Returns the number of ticks in the loop, or 0 if it is empty.
+ */
+unsigned long FrameLoop::get_period(void) const
+{
+    return empty() ? 0 : period;
+}
+
+
+/*  get()
+ *  Purpose:  Returns the encoded frame for the given tick, counting around
+ *            the cycle.  The loop must not be empty.
+ */
+string_view FrameLoop::get(unsigned long tick) const
+{
+    unsigned long t = tick % period;
+    return string_view(bytes.data() + starts[t], starts[t + 1] - starts[t]);
+}
+
+
+/*  print_stats()
+ *  Purpose:  Prints the loop's length, size and how long it took to build,
+ *            on one line.
+ */
+void FrameLoop::print_stats(ostream &output) const
+{
+    if (empty()) {
+        output << "frame loop: no period found" << endl;
+        return;
+    }
+    output << "frame loop: " << period << " frames, "
+           << bytes.size() / 1024 << " KiB, built in "
+           << build_time / 1000000 << " ms" << endl;
+}
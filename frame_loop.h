@@ -0,0 +1,52 @@
+/*---------------------------------------------------------------------------*\
+ *  frame_loop.h                                                             *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the FrameLoop class, which holds one whole cycle of a repeating  *
+ *    animation already encoded, so it can be played over and over without   *
+ *    moving or drawing a single sprite.                                     *
+ *  build() asks the SpriteSystem for the scene's period, and if it has one  *
+ *    no longer than the limit given, draws every tick of one cycle and      *
+ *    keeps the bytes a FrameEncoder makes of each.  All of them are kept    *
+ *    end to end in one buffer.  get() then returns the bytes for any tick.  *
+ *  Frames can be encoded three ways.  FULL and PLAIN frames stand alone,    *
+ *    the same as FrameEncoder::encode_full() and encode_plain().  DIFF      *
+ *    frames hold only the changes from the tick before, as a DiffRenderer   *
+ *    would send them, counting around the cycle, so the first frame holds   *
+ *    the changes from the last.  They can only be sent to a screen that     *
+ *    shows the tick before.                                                 *
+\*---------------------------------------------------------------------------*/
+#ifndef FRAME_LOOP_H_
+#define FRAME_LOOP_H_
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "image.h"
+#include "sprite_system.h"
+#include "layer_cache.h"
+#include "compositor.h"
+
+class FrameLoop
+{
+public:
+    enum Encoding { FULL, PLAIN, DIFF };
+
+    FrameLoop(void);
+
+    bool build(SpriteSystem *sprites, LayerCache *layers,
+               TileCompositor *compositor, Image<char> *canvas,
+               unsigned long limit, Encoding how);
+    bool empty(void) const;
+    unsigned long get_period(void) const;
+    std::string_view get(unsigned long tick) const;
+    void print_stats(std::ostream &output) const;
+
+private:
+    std::string bytes;
+    std::vector<size_t> starts;
+    unsigned long period;
+    long long build_time;
+};
+
+#endif
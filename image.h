@@ -10,12 +10,30 @@
  *  The class is defined with template parameters, to generalize what is     *
  *    meant by "characters".  This way, this class could also hold an image, *
  *    for example, of some sort of Pixel type.                               *
+ *                                                                           *
+ *  Pixels are stored in a single contiguous row-major buffer.  Row r starts *
+ *    at offset r * get_stride(), so whole rows can be handled at once       *
+ *    through row() and data().  The at() and update_at() functions wrap     *
+ *    out-of-bounds coordinates; the _unchecked variants do not, and are     *
+ *    meant for inner loops whose coordinates are already in bounds.         *
+ *  One image can be copied onto another with blit(), which clips to a       *
+ *    rectangle, or blit_wrapped(), which wraps around the edges the same    *
+ *    way update_at() does.                                                  *
 \*---------------------------------------------------------------------------*/
 #ifndef IMAGE_H_
 #define IMAGE_H_
 #include <vector>
 #include <fstream>
 #include <string>
+#include <algorithm>
+
+/*  A rectangle of rows [top, bottom) and columns [left, right).
+ */
+struct Rect
+{
+    int top, left, bottom, right;
+};
+
 
 template <typename T>
 class Image
@@ -30,24 +48,70 @@ public:
     void set_all(T c);
     T at(unsigned row, unsigned col) const;
     void update_at(unsigned row, unsigned col, T c);
+    T at_unchecked(unsigned row, unsigned col) const;
+    void update_at_unchecked(unsigned row, unsigned col, T c);
+
+    void blit(Image<T> const &src, int row, int col, Rect const &clip);
+    void blit(T const *src, unsigned src_height, unsigned src_width,
+              int row, int col, Rect const &clip);
+    void blit_wrapped(Image<T> const &src, unsigned row, unsigned col);
+    Rect bounds(void) const;
+
+    T *row(unsigned r);
+    T const *row(unsigned r) const;
+    T *row_unchecked(unsigned r);
+    T const *row_unchecked(unsigned r) const;
+    T *data(void);
+    T const *data(void) const;
 
     void set_height(unsigned h);
     void set_width(unsigned w);
     unsigned get_height(void) const;
     unsigned get_width(void) const;
+    unsigned get_stride(void) const;
 
 private:
+    void resize(unsigned h, unsigned w);
     unsigned height, width;
-    std::vector< std::vector<T> > board;
+    std::vector<T> board;
 };
 
 
+/*  for_each_wrap()
+ *  Purpose:  Splits an h x w rectangle placed at (row, col) on a surface
+ *            that wraps every wrap_h rows and wrap_w columns into pieces that
+ *            do not wrap.  Calls draw(top, left) once per piece, where
+ *            (top, left) is where the whole rectangle would have to be
+ *            placed, unwrapped, for that piece to land in [0, wrap_h) x
+ *            [0, wrap_w); the caller clips to that area.
+ *  Notes:  - A rectangle no larger than the surface is split at most once
+ *            each way, so there are at most four pieces.
+ *          - Pieces come in the order that makes later source cells land
+ *            after earlier ones, so overlapping pieces of an oversized
+ *            rectangle end up just as if it were drawn cell by cell.
+ */
+template <typename Draw>
+inline void for_each_wrap(unsigned h, unsigned w, unsigned wrap_h,
+                          unsigned wrap_w, unsigned row, unsigned col,
+                          Draw draw)
+{
+    if (wrap_h == 0 || wrap_w == 0) return;
+    int first_top = row % wrap_h;
+    int first_left = col % wrap_w;
+    for (int top = first_top; top + (int) h > 0; top -= wrap_h) {
+        for (int left = first_left; left + (int) w > 0; left -= wrap_w) {
+            draw(top, left);
+        }
+    }
+}
+
+
 /*  Default constructor sets size to 0x0.
  */
 template <typename T>
 inline Image<T>::Image(void)
 {
-    Image(0, 0);
+    height = width = 0;
 }
 
 
@@ -56,9 +120,9 @@ inline Image<T>::Image(void)
 template <typename T>
 inline Image<T>::Image(unsigned h, unsigned w)
 {
-    set_height(h);
-    set_width(w);
-    //  Note clearing happens automatically when these are set.
+    height = width = 0;
+    resize(h, w);
+    //  Note clearing happens automatically when the buffer is allocated.
 }
 
 
@@ -76,13 +140,11 @@ template <>
 inline void Image<char>::read_in(std::istream &input)
 {
     std::string line;
-    for (unsigned row = 0; row < height; ++row) {
+    for (unsigned r = 0; r < height; ++r) {
         unsigned line_width = width;
         getline(input, line);
         if (line.length() < line_width) line_width = line.length();
-        for (unsigned col = 0; col < line_width; ++col) {
-            board[row][col] = line[col];
-        }
+        std::copy(line.data(), line.data() + line_width, row_unchecked(r));
     }
 }
 
@@ -94,10 +156,9 @@ inline void Image<char>::read_in(std::istream &input)
 template <typename T>
 inline void Image<T>::read_in(std::istream &input)
 {
-    for (unsigned row = 0; row < height; ++row) {
-        for (unsigned col = 0; col < width; ++col) {
-            input >> board[row][col];
-        }
+    unsigned size = board.size();
+    for (unsigned i = 0; i < size; ++i) {
+        input >> board[i];
     }
 }
 
@@ -117,15 +178,32 @@ inline std::istream &operator>>(std::istream &input, Image<T> &img)
  *            single line.
  *  Notes:  - Uses the << operator to print each element, and prints a newline
  *            after each row.
+ *          - Does not flush the stream; that is left to the caller, so a
+ *            whole image can go out at once.
  */
 template <typename T>
 inline void Image<T>::display(std::ostream &output) const
 {
-    for (unsigned row = 0; row < height; ++row) {
+    for (unsigned r = 0; r < height; ++r) {
+        T const *cells = row_unchecked(r);
         for (unsigned col = 0; col < width; ++col) {
-            output << board[row][col];
+            output << cells[col];
         }
-        output << std::endl;
+        output << '\n';
+    }
+}
+
+
+/*  display()
+ *  The char version writes each row with a single call rather than one
+ *    character at a time.
+ */
+template <>
+inline void Image<char>::display(std::ostream &output) const
+{
+    for (unsigned r = 0; r < height; ++r) {
+        output.write(row_unchecked(r), width);
+        output << '\n';
     }
 }
 
@@ -150,7 +228,86 @@ inline std::ostream &operator<<(std::ostream &output, Image<T> const &img)
 template <typename T>
 inline void Image<T>::update_at(unsigned row, unsigned col, T c)
 {
-    board[row % height][col % width] = c;
+    board[(row % height) * width + col % width] = c;
+}
+
+
+/*  update_at_unchecked()
+ *  Purpose:  Places the given character at the specified coordinates, which
+ *            must already be in bounds.  No wrapping is done.
+ */
+template <typename T>
+inline void Image<T>::update_at_unchecked(unsigned row, unsigned col, T c)
+{
+    board[row * width + col] = c;
+}
+
+
+/*  blit()
+ *  Purpose:  Copies the given image onto this one, with its top-left corner
+ *            at (row, col).  Only the part inside the clip rectangle, and
+ *            inside this image, is changed.
+ *  Notes:  - No wrapping is done; the position may be negative.
+ *          - Each row is copied as a single block.
+ */
+template <typename T>
+inline void Image<T>::blit(Image<T> const &src, int row, int col,
+                           Rect const &clip)
+{
+    blit(src.data(), src.height, src.width, row, col, clip);
+}
+
+
+/*  blit()
+ *  This version copies from a picture held anywhere in memory, as
+ *    src_height rows of src_width characters each, one right after another.
+ */
+template <typename T>
+inline void Image<T>::blit(T const *src, unsigned src_height,
+                           unsigned src_width, int row, int col,
+                           Rect const &clip)
+{
+    int top = std::max(std::max(row, clip.top), 0);
+    int bottom = std::min(std::min(row + (int) src_height, clip.bottom),
+                          (int) height);
+    int left = std::max(std::max(col, clip.left), 0);
+    int right = std::min(std::min(col + (int) src_width, clip.right),
+                         (int) width);
+    if (left >= right) return;
+    for (int r = top; r < bottom; ++r) {
+        T const *source = src + (size_t) (r - row) * src_width + (left - col);
+        std::copy(source, source + (right - left), row_unchecked(r) + left);
+    }
+}
+
+
+/*  blit_wrapped()
+ *  Purpose:  Copies the given image onto this one, with its top-left corner
+ *            at (row, col), wrapping around the edges exactly as
+ *            update_at() would if every character were placed one by one.
+ *  Notes:  - The image is split into at most four non-wrapping pieces, each
+ *            copied with blit().
+ */
+template <typename T>
+inline void Image<T>::blit_wrapped(Image<T> const &src, unsigned row,
+                                   unsigned col)
+{
+    Rect whole = bounds();
+    for_each_wrap(src.height, src.width, height, width, row, col,
+                  [&](int top, int left) {
+                      blit(src, top, left, whole);
+                  });
+}
+
+
+/*  bounds()
+ *  Purpose:  Returns the rectangle covering the whole image.
+ */
+template <typename T>
+inline Rect Image<T>::bounds(void) const
+{
+    Rect whole = { 0, 0, (int) height, (int) width };
+    return whole;
 }
 
 
@@ -160,11 +317,7 @@ inline void Image<T>::update_at(unsigned row, unsigned col, T c)
 template <typename T>
 inline void Image<T>::set_all(T c)
 {
-    for (unsigned row = 0; row < height; ++row) {
-        for (unsigned col = 0; col < width; ++col) {
-            board[row][col] = c;
-        }
-    }
+    std::fill(board.begin(), board.end(), c);
 }
 
 
@@ -176,7 +329,70 @@ inline void Image<T>::set_all(T c)
 template <typename T>
 inline T Image<T>::at(unsigned row, unsigned col) const
 {
-    return board[row % height][col % width];
+    return board[(row % height) * width + col % width];
+}
+
+
+/*  at_unchecked()
+ *  Purpose:  Returns the character at the given coordinates, which must
+ *            already be in bounds.  No wrapping is done.
+ */
+template <typename T>
+inline T Image<T>::at_unchecked(unsigned row, unsigned col) const
+{
+    return board[row * width + col];
+}
+
+
+/*  row()
+ *  Purpose:  Returns a pointer to the first character of the given row.  The
+ *            row's get_width() characters follow contiguously.
+ *  Notes:  - The row "wraps," just as in update_at().
+ */
+template <typename T>
+inline T *Image<T>::row(unsigned r)
+{
+    return row_unchecked(r % height);
+}
+
+template <typename T>
+inline T const *Image<T>::row(unsigned r) const
+{
+    return row_unchecked(r % height);
+}
+
+
+/*  row_unchecked()
+ *  Purpose:  Returns a pointer to the first character of the given row, which
+ *            must already be in bounds.
+ */
+template <typename T>
+inline T *Image<T>::row_unchecked(unsigned r)
+{
+    return board.data() + r * width;
+}
+
+template <typename T>
+inline T const *Image<T>::row_unchecked(unsigned r) const
+{
+    return board.data() + r * width;
+}
+
+
+/*  data()
+ *  Purpose:  Returns a pointer to the whole buffer, which holds
+ *            get_height() rows of get_stride() characters each.
+ */
+template <typename T>
+inline T *Image<T>::data(void)
+{
+    return board.data();
+}
+
+template <typename T>
+inline T const *Image<T>::data(void) const
+{
+    return board.data();
 }
 
 
@@ -190,9 +406,7 @@ inline T Image<T>::at(unsigned row, unsigned col) const
 template <typename T>
 inline void Image<T>::set_height(unsigned h)
 {
-    height = h;
-    board.resize(height);
-    set_width(width);
+    resize(h, width);
 }
 
 
@@ -206,10 +420,34 @@ inline void Image<T>::set_height(unsigned h)
 template <typename T>
 inline void Image<T>::set_width(unsigned w)
 {
-    width = w;
-    for (unsigned row = 0; row < height; ++row) {
-        board[row].resize(width);
+    resize(height, w);
+}
+
+
+/*  resize()
+ *  Purpose:  A helper for set_height() and set_width().  Reallocates the
+ *            buffer at the new size, keeping whatever part of the old image
+ *            still fits in the top-left corner.
+ *  Notes:  - Changing only the height never moves existing rows, so it can
+ *            be done in place.
+ */
+template <typename T>
+inline void Image<T>::resize(unsigned h, unsigned w)
+{
+    if (w == width) {
+        board.resize(h * w);
+    } else {
+        std::vector<T> resized(h * w);
+        unsigned keep_rows = std::min(h, height);
+        unsigned keep_cols = std::min(w, width);
+        for (unsigned r = 0; r < keep_rows; ++r) {
+            T const *old_row = board.data() + r * width;
+            std::copy(old_row, old_row + keep_cols, resized.data() + r * w);
+        }
+        board.swap(resized);
     }
+    height = h;
+    width = w;
 }
 
 
@@ -233,5 +471,16 @@ inline unsigned Image<T>::get_width(void) const
 }
 
 
+/*  get_stride()
+ *  Purpose:  Returns the distance, in characters, between the starts of two
+ *            consecutive rows in the buffer returned by data().
+ */
+template <typename T>
+inline unsigned Image<T>::get_stride(void) const
+{
+    return width;
+}
+
+
 #endif
 /* IMAGE_H_ */
@@ -0,0 +1,147 @@
+/*---------------------------------------------------------------------------*\
+ *  layer_cache.cpp                                                          *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the LayerCache class.                            *
+\*---------------------------------------------------------------------------*/
+#include "layer_cache.h"
+using namespace std;
+
+
+/*  Default constructor starts with nothing cached.
+ */
+LayerCache::LayerCache(void)
+{
+    profiler = NULL;
+    shown = Viewport();
+}
+
+
+/*  Overloaded constructor takes the background to draw the lowest layer
+ *    over, instead of a blank one.
+ */
+LayerCache::LayerCache(Image<char> const &base) : background(base)
+{
+    profiler = NULL;
+    shown = Viewport();
+}
+
+
+/*  draw_to()
+ *  Purpose:  Clears the given image and draws every sprite onto it, with the
+ *            same result as clearing it to the background (or to spaces, if
+ *            there is none of the right size) and calling
+ *            SpriteSystem::draw_to().
+ *  Parameters: The sprites to draw, and the image to draw them in.  A
+ *            pointer to a TileCompositor to draw layers with, or NULL to
+ *            draw them on this thread.
+ *  Notes:  - Only the layers that all lower layers left unchanged are saved
+ *            in the cache; anything above the lowest change will probably
+ *            have to be drawn again next frame anyway.
+ */
+void LayerCache::draw_to(SpriteSystem const &sprites, Image<char> *board,
+                         TileCompositor *compositor)
+{
+    unsigned layers = sprites.num_layers();
+    unsigned height = board->get_height();
+    unsigned width = board->get_width();
+    if (composites.size() != layers) {
+        composites.assign(layers, Image<char>());
+        valid.assign(layers, false);
+    }
+    unsigned first_change = find_changes(sprites, height, width);
+    unsigned first_stale = 0;
+    while (first_stale < layers && first_stale < first_change &&
+           valid[first_stale] &&
+           composites[first_stale].get_height() == height &&
+           composites[first_stale].get_width() == width) {
+        ++first_stale;
+    }
+    {
+        StageTimer timing(profiler, STAGE_CLEAR);
+        if (first_stale == 0) {
+            if (background.get_height() == height &&
+                background.get_width() == width) {
+                *board = background;
+            } else {
+                board->set_all(' ');
+            }
+        } else {
+            *board = composites[first_stale - 1];
+        }
+    }
+    StageTimer timing(profiler, STAGE_DRAW);
+    for (unsigned l = first_stale; l < layers; ++l) {
+        unsigned begin = sprites.layer_begin(l);
+        unsigned end = sprites.layer_end(l);
+        if (compositor != NULL) {
+            compositor->draw_range(sprites, board, begin, end);
+        } else {
+            sprites.draw_range(board, begin, end);
+        }
+        valid[l] = (l < first_change);
+        if (valid[l]) composites[l] = *board;
+    }
+}
+
+
+/*  invalidate()
+ *  Purpose:  Empties the cache, so every layer is drawn again next time.
+ */
+void LayerCache::invalidate(void)
+{
+    valid.assign(valid.size(), false);
+}
+
+
+/*  set_profiler()
+ *  Purpose:  Sets the profiler to time each frame's stages with, or NULL to
+ *            stop timing them.
+ */
+void LayerCache::set_profiler(FrameProfiler *frame_profiler)
+{
+    profiler = frame_profiler;
+}
+
+
+/*  find_changes()
+ *  Purpose:  A helper function that compares each sprite's state with how
+ *            it was last drawn, and records the new state.
+ *  Parameters: The sprites, and the size of the board they are drawn on.
+ *  Returns:  The lowest layer with a change in it, or the number of layers
+ *            if nothing changed.
+ *  Notes:  - A sprite that changed out of view, and was out of view before,
+ *            changed nothing on the board, so it is not counted.
+ */
+unsigned LayerCache::find_changes(SpriteSystem const &sprites,
+                                  unsigned height, unsigned width)
+{
+    unsigned count = sprites.size();
+    unsigned first_change = sprites.num_layers();
+    if (drawn.size() != count) {
+        drawn.resize(count);
+        in_view.assign(count, true);
+        first_change = 0;
+    }
+    Viewport view = sprites.get_viewport(height, width);
+    bool panned = (view != shown);
+    if (panned) {
+        shown = view;
+        first_change = 0;
+    }
+    for (unsigned l = 0; l < sprites.num_layers(); ++l) {
+        unsigned end = sprites.layer_end(l);
+        for (unsigned i = sprites.layer_begin(l); i < end; ++i) {
+            DrawState state = sprites.get_state(i);
+            bool changed = (state != drawn[i]);
+            if (!changed && !panned) continue;
+            drawn[i] = state;
+            bool visible = sprites.is_visible(i, height, width);
+            if (changed && (visible || in_view[i]) && l < first_change) {
+                first_change = l;
+            }
+            in_view[i] = visible;
+        }
+    }
+    return first_change;
+}
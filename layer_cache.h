@@ -0,0 +1,53 @@
+/*---------------------------------------------------------------------------*\
+ *  layer_cache.h                                                            *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the LayerCache class, which draws a SpriteSystem one layer at a  *
+ *    time and keeps what it drew, so that layers that have not changed do   *
+ *    not have to be drawn again.                                            *
+ *  For each layer, the cache can hold the composite of that layer and every *
+ *    layer below it.  Each frame, it finds the lowest layer in which some   *
+ *    sprite moved or changed frame.  Everything below that layer is copied  *
+ *    from the cache in one go, and only that layer and the ones above it    *
+ *    are drawn.  So a still background under a few busy layers is drawn     *
+ *    once, then reused for as long as it stays still.                       *
+ *  The lowest layer is drawn over a background image, which is blank unless *
+ *    one is given.                                                          *
+ *  With a viewport, only sprites that are in view, or were when last drawn, *
+ *    count as changes, and moving the viewport redraws every layer.         *
+ *  Given a FrameProfiler, the cache times starting the frame (from the      *
+ *    background or a cached composite) as the clear stage, and drawing the  *
+ *    layers above as the draw stage.                                        *
+\*---------------------------------------------------------------------------*/
+#ifndef LAYER_CACHE_H_
+#define LAYER_CACHE_H_
+#include <vector>
+#include "image.h"
+#include "sprite_system.h"
+#include "compositor.h"
+#include "profiler.h"
+
+class LayerCache
+{
+public:
+    LayerCache(void);
+    LayerCache(Image<char> const &base);
+
+    void draw_to(SpriteSystem const &sprites, Image<char> *board,
+                 TileCompositor *compositor);
+    void invalidate(void);
+    void set_profiler(FrameProfiler *frame_profiler);
+
+private:
+    unsigned find_changes(SpriteSystem const &sprites, unsigned height,
+                          unsigned width);
+    Image<char> background;
+    std::vector< Image<char> > composites;
+    std::vector<bool> valid;
+    std::vector<DrawState> drawn;
+    std::vector<bool> in_view;          // Whether each was drawn in view
+    Viewport shown;
+    FrameProfiler *profiler;
+};
+
+#endif
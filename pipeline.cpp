@@ -0,0 +1,89 @@
+/*---------------------------------------------------------------------------*\
+ *  pipeline.cpp                                                             *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the FramePipeline class.                         *
+\*---------------------------------------------------------------------------*/
+#include "pipeline.h"
+using namespace std;
+
+
+/*  Constructor takes an image of the canvas's size, which every buffer
+ *    starts as, and the function that sends a frame out.  Starts the output
+ *    thread, which calls that function and nothing else.
+ */
+FramePipeline::FramePipeline(Image<char> const &blank,
+                             function<void(Image<char> const &)> const &output)
+    : buffers(blank), show(output)
+{
+    published = written = 0;
+    writer = thread(&FramePipeline::output_loop, this);
+}
+
+
+/*  Destructor sends the last frame published, if it has not been, and
+ *    stops the output thread.
+ */
+FramePipeline::~FramePipeline(void)
+{
+    finish();
+}
+
+
+/*  get_canvas()
+ *  Purpose:  Returns the image the next frame should be drawn in.
+ *  Notes:  - It may hold any earlier frame, so it must be drawn over
+ *            completely.
+ */
+Image<char> *FramePipeline::get_canvas(void)
+{
+    return &buffers.get_back();
+}
+
+
+/*  publish()
+ *  Purpose:  Hands the frame just drawn to the output thread.
+ */
+void FramePipeline::publish(void)
+{
+    buffers.publish();
+    ++published;
+}
+
+
+/*  finish()
+ *  Purpose:  Waits for the output thread to send the last frame published,
+ *            then stops it.  Nothing may be published afterwards.
+ */
+void FramePipeline::finish(void)
+{
+    if (!writer.joinable()) return;
+    buffers.close();
+    writer.join();
+}
+
+
+/*  print_stats()
+ *  Purpose:  Prints how many frames were published and how many of them were
+ *            actually sent, on one line.
+ *  Notes:  - Call finish() first, so the output thread is not still counting.
+ */
+void FramePipeline::print_stats(ostream &output) const
+{
+    output << "frames published: " << published
+           << "  written: " << written
+           << "  skipped: " << published - written << endl;
+}
+
+
+/*  output_loop()
+ *  Purpose:  The body of the output thread: sends each new frame until the
+ *            pipeline is finished.
+ */
+void FramePipeline::output_loop(void)
+{
+    while (buffers.wait_for_update()) {
+        show(buffers.get_front());
+        ++written;
+    }
+}
@@ -0,0 +1,45 @@
+/*---------------------------------------------------------------------------*\
+ *  pipeline.h                                                               *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the FramePipeline class, which sends frames to the terminal on   *
+ *    a thread of their own, so that a slow write does not hold up the       *
+ *    simulation.                                                            *
+ *  The animation draws each frame into get_canvas() and then publishes it.  *
+ *    Frames are handed to the output thread through a TripleBuffer, so      *
+ *    publishing never waits.  The output thread always sends the newest     *
+ *    frame; any published while it was still writing are skipped.           *
+\*---------------------------------------------------------------------------*/
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+#include <functional>
+#include <ostream>
+#include <thread>
+#include "image.h"
+#include "triple_buffer.h"
+
+class FramePipeline
+{
+public:
+    FramePipeline(Image<char> const &blank,
+                  std::function<void(Image<char> const &)> const &output);
+    ~FramePipeline(void);
+
+    Image<char> *get_canvas(void);
+    void publish(void);
+    void finish(void);
+
+    void print_stats(std::ostream &output) const;
+
+private:
+    FramePipeline(FramePipeline const &);
+    FramePipeline &operator=(FramePipeline const &);
+    void output_loop(void);
+
+    TripleBuffer< Image<char> > buffers;
+    std::function<void(Image<char> const &)> show;
+    std::thread writer;
+    unsigned long published, written;
+};
+
+#endif
@@ -0,0 +1,240 @@
+/*---------------------------------------------------------------------------*\
+ *  profiler.cpp                                                             *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the Histogram, FrameProfiler and StageTimer      *
+ *    classes.  All times are in nanoseconds.                                *
+\*---------------------------------------------------------------------------*/
+#include <bit>
+#include <cstdio>
+#include "profiler.h"
+#include "scheduler.h"
+using namespace std;
+
+static char const *const STAGE_NAMES[NUM_STAGES] = {
+    "clear", "draw", "advance", "encode", "write", "input"
+};
+
+
+/*  Constructor starts with nothing recorded.
+ */
+Histogram::Histogram(void)
+{
+    for (unsigned b = 0; b < NUM_BUCKETS; ++b) {
+        buckets[b].store(0, memory_order_relaxed);
+    }
+    count.store(0, memory_order_relaxed);
+    total.store(0, memory_order_relaxed);
+    max.store(0, memory_order_relaxed);
+}
+
+
+/*  record()
+ *  Purpose:  Adds one time to the histogram.  Negative times count as 0.
+ */
+void Histogram::record(long long ns)
+{
+    if (ns < 0) ns = 0;
+    add(&buckets[bucket_of(ns)], 1);
+    add(&count, 1);
+    add(&total, ns);
+    if (ns > max.load(memory_order_relaxed)) {
+        max.store(ns, memory_order_relaxed);
+    }
+}
+
+
+/*  add()
+ *  Purpose:  A helper function that adds to a counter.
+ *  Notes:  - Only one thread records into a histogram, so this is a plain
+ *            load and store rather than a locked read-modify-write.  The
+ *            atomics only make it safe for other threads to read.
+ */
+void Histogram::add(atomic<unsigned long> *value, unsigned long amount)
+{
+    value->store(value->load(memory_order_relaxed) + amount,
+                 memory_order_relaxed);
+}
+
+
+/*  get_count()
+ *  Purpose:  Returns the number of times recorded.
+ */
+unsigned long Histogram::get_count(void) const
+{
+    return count.load(memory_order_relaxed);
+}
+
+
+/*  percentile()
+ *  Purpose:  Returns a time that the given fraction of recorded times are no
+ *            longer than, such as 0.99 for the 99th percentile.
+ *  Notes:  - The time returned is the top of the bucket the percentile falls
+ *            in, but never more than the longest time recorded.
+ */
+long long Histogram::percentile(double fraction) const
+{
+    unsigned long recorded = get_count();
+    if (recorded == 0) return 0;
+    unsigned long rank = (unsigned long) (fraction * recorded);
+    if (rank >= recorded) rank = recorded - 1;
+    unsigned long seen = 0;
+    for (unsigned b = 0; b < NUM_BUCKETS; ++b) {
+        seen += buckets[b].load(memory_order_relaxed);
+        if (seen > rank) return std::min(bucket_top(b), get_max());
+    }
+    return get_max();
+}
+
+
+/*  get_max(), get_mean()
+ *  Purpose:  Return the longest and the average of the times recorded.
+ */
+long long Histogram::get_max(void) const
+{
+    return max.load(memory_order_relaxed);
+}
+
+double Histogram::get_mean(void) const
+{
+    unsigned long recorded = get_count();
+    return (recorded == 0) ? 0
+           : (double) total.load(memory_order_relaxed) / recorded;
+}
+
+
+/*  bucket_of()
+ *  Purpose:  A helper function that finds which bucket a time goes in.
+ *  Notes:  - Above 16, the bucket is picked by the position of the highest
+ *            set bit and the three bits after it.
+ */
+unsigned Histogram::bucket_of(long long ns)
+{
+    if (ns < 16) return ns;
+    unsigned long long value = ns;
+    unsigned power = bit_width(value) - 1;        // At least 4
+    unsigned eighth = (value >> (power - 3)) & 7;
+    return 16 + (power - 4) * 8 + eighth;
+}
+
+
+/*  bucket_top()
+ *  Purpose:  A helper function that returns the longest time that goes in
+ *            the given bucket.
+ */
+long long Histogram::bucket_top(unsigned bucket)
+{
+    if (bucket < 16) return bucket;
+    unsigned power = (bucket - 16) / 8 + 4;
+    long long eighth = (bucket - 16) % 8;
+    long long step = 1LL << (power - 3);
+    return (8 + eighth) * step + step - 1;
+}
+
+
+/*  record()
+ *  Purpose:  Adds a time to the given stage's histogram.
+ */
+void FrameProfiler::record(Stage stage, long long ns)
+{
+    stages[stage].record(ns);
+}
+
+
+/*  get()
+ *  Purpose:  Returns the histogram of the given stage's times.
+ */
+Histogram const &FrameProfiler::get(Stage stage) const
+{
+    return stages[stage];
+}
+
+
+/*  stage_name()
+ *  Purpose:  Returns the name of a stage, as used in reports.
+ */
+char const *FrameProfiler::stage_name(Stage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+
+/*  hud_line()
+ *  Purpose:  Returns a short summary of every stage, on one line, to be
+ *            shown over the animation: the median and 99th percentile of
+ *            each stage, in microseconds.
+ */
+string FrameProfiler::hud_line(void) const
+{
+    string line = "us p50/p99";
+    for (unsigned s = 0; s < NUM_STAGES; ++s) {
+        char part[64];
+        snprintf(part, sizeof(part), " | %s %lld/%lld", STAGE_NAMES[s],
+                 stages[s].percentile(0.5) / 1000,
+                 stages[s].percentile(0.99) / 1000);
+        line += part;
+    }
+    return line;
+}
+
+
+/*  print_summary()
+ *  Purpose:  Prints a table of how many times each stage ran, and its
+ *            median, 99th percentile, longest and average times, in
+ *            microseconds.
+ */
+void FrameProfiler::print_summary(ostream &output) const
+{
+    char line[128];
+    snprintf(line, sizeof(line), "%-8s %10s %10s %10s %10s %10s\n", "stage",
+             "count", "p50 us", "p99 us", "max us", "mean us");
+    output << line;
+    for (unsigned s = 0; s < NUM_STAGES; ++s) {
+        Histogram const &times = stages[s];
+        snprintf(line, sizeof(line),
+                 "%-8s %10lu %10.1f %10.1f %10.1f %10.1f\n", STAGE_NAMES[s],
+                 times.get_count(), times.percentile(0.5) / 1000.0,
+                 times.percentile(0.99) / 1000.0, times.get_max() / 1000.0,
+                 times.get_mean() / 1000.0);
+        output << line;
+    }
+    output.flush();
+}
+
+
+/*  write_csv()
+ *  Purpose:  Writes the same figures as print_summary(), as CSV with a
+ *            header line, in nanoseconds.
+ */
+void FrameProfiler::write_csv(ostream &output) const
+{
+    output << "stage,count,p50_ns,p99_ns,max_ns,mean_ns\n";
+    for (unsigned s = 0; s < NUM_STAGES; ++s) {
+        Histogram const &times = stages[s];
+        output << STAGE_NAMES[s] << "," << times.get_count() << ","
+               << times.percentile(0.5) << "," << times.percentile(0.99)
+               << "," << times.get_max() << ","
+               << (long long) times.get_mean() << "\n";
+    }
+    output.flush();
+}
+
+
+/*  Constructor starts timing the given stage, unless the profiler is NULL.
+ */
+StageTimer::StageTimer(FrameProfiler *frame_profiler, Stage timed)
+{
+    profiler = frame_profiler;
+    stage = timed;
+    start = (profiler != NULL) ? FrameScheduler::now() : 0;
+}
+
+
+/*  Destructor records the time since the timer was made.
+ */
+StageTimer::~StageTimer(void)
+{
+    if (profiler != NULL) {
+        profiler->record(stage, FrameScheduler::now() - start);
+    }
+}
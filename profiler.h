@@ -0,0 +1,87 @@
+/*---------------------------------------------------------------------------*\
+ *  profiler.h                                                               *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the FrameProfiler class, which keeps track of how long each      *
+ *    stage of making a frame takes, so that it is possible to tell which    *
+ *    one is at fault when an animation stutters.                            *
+ *  Each stage has a Histogram of its times.  A Histogram has a fixed set of *
+ *    buckets, eight for every power of two, so recording a time is just an  *
+ *    increment and percentiles are accurate to within an eighth.            *
+ *  Stages are timed with a StageTimer, which records the time from when it  *
+ *    is made until it goes out of scope.  A StageTimer given a NULL         *
+ *    profiler does nothing, so timing can be turned off without changing    *
+ *    the code being timed.                                                  *
+ *  Each stage should only ever be recorded by one thread.  Reading the      *
+ *    results from another thread, as the HUD does, is safe, though they may *
+ *    be a frame out of date.                                                *
+\*---------------------------------------------------------------------------*/
+#ifndef PROFILER_H_
+#define PROFILER_H_
+#include <atomic>
+#include <ostream>
+#include <string>
+
+enum Stage
+{
+    STAGE_CLEAR, STAGE_DRAW, STAGE_ADVANCE, STAGE_ENCODE, STAGE_WRITE,
+    STAGE_INPUT, NUM_STAGES
+};
+
+
+class Histogram
+{
+public:
+    Histogram(void);
+
+    void record(long long ns);
+    unsigned long get_count(void) const;
+    long long percentile(double fraction) const;
+    long long get_max(void) const;
+    double get_mean(void) const;
+
+private:
+    //  Times below 16 ns get a bucket each; above that, eight per power of
+    //    two, up to 2^63.
+    static const unsigned NUM_BUCKETS = 16 + 60 * 8;
+    static unsigned bucket_of(long long ns);
+    static long long bucket_top(unsigned bucket);
+    void add(std::atomic<unsigned long> *value, unsigned long amount);
+
+    std::atomic<unsigned long> buckets[NUM_BUCKETS];
+    std::atomic<unsigned long> count, total;
+    std::atomic<long long> max;
+};
+
+
+class FrameProfiler
+{
+public:
+    void record(Stage stage, long long ns);
+    Histogram const &get(Stage stage) const;
+    static char const *stage_name(Stage stage);
+
+    std::string hud_line(void) const;
+    void print_summary(std::ostream &output) const;
+    void write_csv(std::ostream &output) const;
+
+private:
+    Histogram stages[NUM_STAGES];
+};
+
+
+class StageTimer
+{
+public:
+    StageTimer(FrameProfiler *frame_profiler, Stage timed);
+    ~StageTimer(void);
+
+private:
+    StageTimer(StageTimer const &);
+    StageTimer &operator=(StageTimer const &);
+    FrameProfiler *profiler;
+    Stage stage;
+    long long start;
+};
+
+#endif
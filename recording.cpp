@@ -0,0 +1,591 @@
+/*---------------------------------------------------------------------------*\
+ *  recording.cpp                                                            *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the SessionRecorder and RecordingReader classes, *
+ *    and the layout of a recording.  A recording is a header, then every    *
+ *    frame in the order it was sent, each a FrameHeader followed by its     *
+ *    bytes, then the index: an array of RecordingKeys, one per keyframe, in *
+ *    order of time.  All offsets are in bytes from the start of the file.   *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "recording.h"
+#include "frame_encoder.h"
+#include "scheduler.h"
+using namespace std;
+
+static const char MAGIC[8] = "ANIMREC";
+static const uint32_t VERSION = 1;
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t height, width, fps;
+    uint32_t padding;
+    uint64_t index, num_keys;                   // 0 until it is closed
+};
+
+struct FrameHeader
+{
+    uint64_t tick;
+    int64_t time;
+    uint32_t length;
+    uint32_t key;
+};
+
+//  A frame is written as a keyframe once this many deltas follow the last.
+static const unsigned KEYFRAME_INTERVAL = 256;
+
+//  The writer thread wakes this often, or sooner once WRITE_BATCH bytes are
+//    waiting, so that it writes in batches rather than once per frame.
+static const chrono::milliseconds WRITE_INTERVAL(100);
+static const size_t WRITE_BATCH = 1 << 20;
+
+//  record() waits for the writer thread if this many bytes are waiting.
+static const size_t MAX_PENDING = 64 << 20;
+
+
+/*  Default constructor makes a recorder with no file open.
+ */
+SessionRecorder::SessionRecorder(void)
+{
+    fd = -1;
+    fps = 0;
+    start = 0;
+    position = 0;
+    stopping = failed = false;
+    cursor_row = cursor_col = 0;
+    since_key = 0;
+    frames_since_key = 0;
+    frames = keyframes = 0;
+    bytes_in = 0;
+}
+
+
+/*  Destructor closes the recording, if it is still open.
+ */
+SessionRecorder::~SessionRecorder(void)
+{
+    string error;
+    close(&error);
+}
+
+
+/*  fill_header()
+ *  Purpose:  A helper function that sets up the header of a recording of
+ *            the given size and frame rate, with no index.
+ */
+static void fill_header(Header *header, unsigned height, unsigned width,
+                        unsigned fps)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    header->version = VERSION;
+    header->byte_order = BYTE_ORDER_MARK;
+    header->height = height;
+    header->width = width;
+    header->fps = fps;
+}
+
+
+/*  open()
+ *  Purpose:  Starts recording to the named file, replacing anything in it.
+ *  Parameters: The name of the file.  The size of the frames that will be
+ *            recorded, and the frame rate they are shown at.  A string to
+ *            describe any error in.
+ *  Returns:  True if the file was opened and its header written.
+ *  Notes:  - Times in the recording are counted from here.
+ */
+bool SessionRecorder::open(char const *name, unsigned height,
+                           unsigned width, unsigned frame_rate,
+                           string *error)
+{
+    if (fd >= 0) close(error);
+    fd = ::open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        *error = "could not open the file for writing";
+        return false;
+    }
+    Header header;
+    fill_header(&header, height, width, frame_rate);
+    if (!write_out(&header, sizeof(header))) {
+        ::close(fd);
+        fd = -1;
+        *error = "could not write to the file";
+        return false;
+    }
+    fps = frame_rate;
+    position = sizeof(header);
+    screen = Image<char>(height, width);
+    screen.set_all(' ');
+    cursor_row = cursor_col = 0;
+    index.clear();
+    since_key = 0;
+    frames_since_key = 0;
+    frames = keyframes = 0;
+    bytes_in = 0;
+    stopping = failed = false;
+    start = FrameScheduler::now();
+    writer = thread(&SessionRecorder::write_loop, this);
+    return true;
+}
+
+
+/*  is_open()
+ *  Purpose:  Returns whether the recorder is recording.
+ */
+bool SessionRecorder::is_open(void) const
+{
+    return fd >= 0;
+}
+
+
+/*  record()
+ *  Purpose:  Adds a frame to the recording.
+ *  Parameters: The tick of the animation the frame shows.  The bytes that
+ *            were sent to the terminal for it, and how many there are.
+ *  Notes:  - The bytes are only copied into a queue for the writer thread,
+ *            which is woken once there are enough of them for a batch.
+ *            The caller only ever waits if the writer has fallen more than
+ *            MAX_PENDING bytes behind.
+ *          - Frames with no bytes change nothing on the screen, so they are
+ *            not recorded.
+ */
+void SessionRecorder::record(unsigned long tick, char const *bytes,
+                             size_t size)
+{
+    if (fd < 0 || size == 0) return;
+    FrameHeader header;
+    header.tick = tick;
+    header.time = FrameScheduler::now() - start;
+    header.length = size;
+    header.key = 0;
+    unique_lock<mutex> hold(lock);
+    while (pending.size() > MAX_PENDING && !failed) drained.wait(hold);
+    bool was_short = pending.size() < WRITE_BATCH;
+    pending.append((char const *) &header, sizeof(header));
+    pending.append(bytes, size);
+    bool batch_ready = was_short && pending.size() >= WRITE_BATCH;
+    hold.unlock();
+    if (batch_ready) wake.notify_one();
+}
+
+
+/*  close()
+ *  Purpose:  Writes out every frame still waiting, adds the index, and
+ *            closes the file.
+ *  Returns:  False, with a message in the given string, if any of the
+ *            recording could not be written.
+ *  Notes:  - Does nothing if no file is open.
+ */
+bool SessionRecorder::close(string *error)
+{
+    if (fd < 0) return true;
+    {
+        lock_guard<mutex> hold(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    Header header;
+    fill_header(&header, screen.get_height(), screen.get_width(), fps);
+    header.index = position;
+    header.num_keys = index.size();
+    bool written = !failed &&
+                   write_out(index.data(),
+                             index.size() * sizeof(RecordingKey)) &&
+                   pwrite(fd, &header, sizeof(header), 0) ==
+                       (ssize_t) sizeof(header);
+    ::close(fd);
+    fd = -1;
+    if (!written) *error = "could not write the whole recording";
+    return written;
+}
+
+
+/*  write_loop()
+ *  Purpose:  A helper function that runs on the writer thread, taking the
+ *            frames waiting in batches and writing each batch with one
+ *            write().
+ *  Notes:  - Each frame is first applied to the model of the screen by
+ *            follow().  It is written as a keyframe, from the model, if it
+ *            is the first, if KEYFRAME_INTERVAL deltas have followed the
+ *            last keyframe, or if the deltas since then add up to more than
+ *            a whole frame, so that seeking never sends much more than two
+ *            frames' worth.  Otherwise it is written as it was sent.
+ *          - Returns once close() has asked it to and the queue is empty.
+ */
+void SessionRecorder::write_loop(void)
+{
+    FrameEncoder keyframe(-1);
+    size_t whole = screen.get_height() * (screen.get_width() + 1) + 3;
+    string batch, out;
+    unique_lock<mutex> hold(lock);
+    for (;;) {
+        wake.wait_for(hold, WRITE_INTERVAL, [this] {
+            return stopping || pending.size() >= WRITE_BATCH;
+        });
+        bool stop = stopping;
+        batch.clear();
+        batch.swap(pending);
+        hold.unlock();
+        drained.notify_all();
+
+        out.clear();
+        size_t at = 0;
+        while (batch.size() - at >= sizeof(FrameHeader)) {
+            FrameHeader header;
+            memcpy(&header, batch.data() + at, sizeof(header));
+            char const *bytes = batch.data() + at + sizeof(header);
+            at += sizeof(header) + header.length;
+            follow(bytes, header.length);
+            ++frames;
+            bytes_in += header.length;
+            if (frames == 1 || frames_since_key >= KEYFRAME_INTERVAL ||
+                since_key + header.length > whole) {
+                RecordingKey key = { header.time, position + out.size() };
+                index.push_back(key);
+                keyframe.begin_frame();
+                keyframe.encode_full(screen);
+                header.key = 1;
+                header.length = keyframe.get_buffer().size();
+                bytes = keyframe.get_buffer().data();
+                since_key = 0;
+                frames_since_key = 0;
+                ++keyframes;
+            } else {
+                since_key += header.length;
+                ++frames_since_key;
+            }
+            out.append((char const *) &header, sizeof(header));
+            out.append(bytes, header.length);
+        }
+        bool written = failed || write_out(out.data(), out.size());
+        position += out.size();
+
+        hold.lock();
+        if (!written) failed = true;
+        if (stop) return;
+    }
+}
+
+
+/*  follow()
+ *  Purpose:  A helper function that applies bytes sent to the terminal to
+ *            the model of the screen.
+ *  Notes:  - Understands what a FrameEncoder sends: printable characters,
+ *            newlines, and cursor movements (ESC [ row ; col H).  Any other
+ *            control sequence is skipped.  Characters off the screen are
+ *            dropped.
+ */
+void SessionRecorder::follow(char const *bytes, size_t size)
+{
+    unsigned height = screen.get_height();
+    unsigned width = screen.get_width();
+    size_t i = 0;
+    while (i < size) {
+        char c = bytes[i++];
+        if (c == '\033' && i < size && bytes[i] == '[') {
+            unsigned numbers[2] = { 0, 0 };
+            unsigned count = 0;
+            for (++i; i < size && (isdigit((unsigned char) bytes[i]) ||
+                                   bytes[i] == ';'); ++i) {
+                if (bytes[i] == ';') {
+                    ++count;
+                } else if (count < 2) {
+                    numbers[count] = numbers[count] * 10 + (bytes[i] - '0');
+                }
+            }
+            if (i < size && bytes[i++] == 'H') {
+                cursor_row = (numbers[0] == 0) ? 0 : numbers[0] - 1;
+                cursor_col = (numbers[1] == 0) ? 0 : numbers[1] - 1;
+            }
+        } else if (c == '\n') {
+            ++cursor_row;
+            cursor_col = 0;
+        } else if (c == '\r') {
+            cursor_col = 0;
+        } else {
+            if (cursor_row < height && cursor_col < width) {
+                screen.update_at_unchecked(cursor_row, cursor_col, c);
+            }
+            ++cursor_col;
+        }
+    }
+}
+
+
+/*  write_out()
+ *  Purpose:  A helper function that writes the given bytes at the end of
+ *            the file.
+ *  Returns:  True if everything was written, false on an error.
+ */
+bool SessionRecorder::write_out(void const *bytes, size_t size)
+{
+    char const *next = (char const *) bytes;
+    while (size > 0) {
+        ssize_t written = write(fd, next, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        next += written;
+        size -= written;
+    }
+    return true;
+}
+
+
+/*  print_stats()
+ *  Purpose:  Prints how many frames were recorded, how many were written
+ *            as keyframes, and the bytes sent against the bytes written, on
+ *            one line.
+ *  Notes:  - Only to be called once the recording has been closed.
+ */
+void SessionRecorder::print_stats(ostream &output) const
+{
+    output << "recording: " << frames << " frames, " << keyframes
+           << " keyframes, " << bytes_in / 1024 << " KiB sent, "
+           << position / 1024 << " KiB written" << endl;
+}
+
+
+/*  Default constructor makes a reader with no file open.
+ */
+RecordingReader::RecordingReader(void)
+{
+    base = NULL;
+    size = first = end = position = 0;
+    height = width = fps = 0;
+}
+
+
+/*  Destructor unmaps the file, if one is open.
+ */
+RecordingReader::~RecordingReader(void)
+{
+    if (base != NULL) munmap(const_cast<char *>(base), size);
+}
+
+
+/*  open()
+ *  Purpose:  Opens the named recording, ready to read from its start.
+ *  Returns:  False, with a message in the given string, if the file could
+ *            not be read or is not a recording.
+ *  Notes:  - The file is mapped into memory, so frames are handed out from
+ *            it without copying.
+ *          - If the file has no index, or its index is damaged, one is
+ *            built by build_index() instead.
+ */
+bool RecordingReader::open(char const *name, string *error)
+{
+    if (base != NULL) munmap(const_cast<char *>(base), size);
+    base = NULL;
+    keys.clear();
+    int fd = ::open(name, O_RDONLY);
+    if (fd < 0) {
+        *error = "could not open the file";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (uint64_t) info.st_size < sizeof(Header)) {
+        ::close(fd);
+        *error = "the file is too short to be a recording";
+        return false;
+    }
+    size = info.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        *error = "could not map the file into memory";
+        return false;
+    }
+    base = (char const *) mapped;
+
+    Header header;
+    memcpy(&header, base, sizeof(header));
+    char const *problem = NULL;
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        problem = "the file is not a recording";
+    } else if (header.byte_order != BYTE_ORDER_MARK) {
+        problem = "the recording was made on a machine with another byte "
+                  "order";
+    } else if (header.version != VERSION) {
+        problem = "the recording was made with another version of the format";
+    }
+    if (problem != NULL) {
+        munmap(mapped, size);
+        base = NULL;
+        *error = problem;
+        return false;
+    }
+    height = header.height;
+    width = header.width;
+    fps = header.fps;
+    first = position = sizeof(header);
+    end = size;
+
+    bool indexed = header.index >= first && header.index <= size &&
+                   header.num_keys <= (size - header.index) /
+                                      sizeof(RecordingKey);
+    if (indexed) {
+        keys.resize(header.num_keys);
+        memcpy(keys.data(), base + header.index,
+               keys.size() * sizeof(RecordingKey));
+        end = header.index;
+        for (size_t k = 0; indexed && k < keys.size(); ++k) {
+            indexed = keys[k].offset >= first && keys[k].offset < end &&
+                      (k == 0 || keys[k - 1].time <= keys[k].time);
+        }
+    }
+    if (!indexed) {
+        end = size;
+        build_index();
+    }
+    return true;
+}
+
+
+/*  build_index()
+ *  Purpose:  A helper function that finds the keyframes by reading through
+ *            every frame, for a recording with no index.
+ *  Notes:  - Stops at the first frame that does not fit in the file, which
+ *            is where a recording that was cut off ends.  Nothing after it
+ *            is read.
+ */
+void RecordingReader::build_index(void)
+{
+    keys.clear();
+    position = first;
+    uint64_t at = position;
+    RecordedFrame frame;
+    while (next(&frame)) {
+        if (frame.key) {
+            RecordingKey key = { frame.time, at };
+            if (keys.empty() || keys.back().time <= key.time) {
+                keys.push_back(key);
+            }
+        }
+        at = position;
+    }
+    end = at;
+    position = first;
+}
+
+
+/*  get_height(), get_width(), get_fps()
+ *  Purpose:  Return the size of the recorded frames, and the frame rate the
+ *            animation ran at.
+ */
+unsigned RecordingReader::get_height(void) const
+{
+    return height;
+}
+
+unsigned RecordingReader::get_width(void) const
+{
+    return width;
+}
+
+unsigned RecordingReader::get_fps(void) const
+{
+    return fps;
+}
+
+
+/*  seek()
+ *  Purpose:  Moves to the last keyframe at or before the given time, in
+ *            nanoseconds from the start of the recording, so that next()
+ *            reads from there.
+ *  Notes:  - Finds it with a binary search of the index.  The caller should
+ *            show every frame from there up to the time it wants, to bring
+ *            the screen up to date.
+ *          - Before the first keyframe, moves to the start.
+ */
+void RecordingReader::seek(int64_t time)
+{
+    auto later = upper_bound(keys.begin(), keys.end(), time,
+                             [](int64_t t, RecordingKey const &key) {
+                                 return t < key.time;
+                             });
+    position = (later == keys.begin()) ? first : (later - 1)->offset;
+}
+
+
+/*  next()
+ *  Purpose:  Reads the next frame.
+ *  Returns:  False at the end of the recording.
+ *  Notes:  - The frame's bytes point into the mapped file, so they last as
+ *            long as the reader does.
+ */
+bool RecordingReader::next(RecordedFrame *frame)
+{
+    if (base == NULL || end - position < sizeof(FrameHeader)) return false;
+    FrameHeader header;
+    memcpy(&header, base + position, sizeof(header));
+    uint64_t after = position + sizeof(header);
+    if (header.length > end - after) return false;
+    frame->tick = header.tick;
+    frame->time = header.time;
+    frame->key = header.key != 0;
+    frame->bytes = string_view(base + after, header.length);
+    position = after + header.length;
+    return true;
+}
+
+
+/*  write_asciicast()
+ *  Purpose:  Writes the whole recording to the given stream in the
+ *            asciicast v2 format: a line with a JSON header, then a line
+ *            with a JSON array for each frame.
+ *  Returns:  False if the stream failed.
+ *  Notes:  - The screen is cleared at the start, as the animation does.
+ *            The height is one more than a frame's, since a whole frame
+ *            leaves the cursor on the line below it.
+ *          - Terminals turn each newline the animation sends into a return
+ *            as well, so newlines are written as both.  Control characters,
+ *            quotes and backslashes are escaped for JSON.
+ *          - Leaves the reader at the end of the recording.
+ */
+bool RecordingReader::write_asciicast(ostream &output)
+{
+    output << "{\"version\": 2, \"width\": " << width << ", \"height\": "
+           << height + 1 << "}\n";
+    output << "[0.000000, \"o\", \"\\u001b[2J\"]\n";
+    position = first;
+    RecordedFrame frame;
+    string text;
+    char buffer[32];
+    while (next(&frame)) {
+        text.clear();
+        for (char c : frame.bytes) {
+            unsigned char byte = c;
+            if (c == '\n') {
+                text += "\\r\\n";
+            } else if (c == '"' || c == '\\') {
+                text += '\\';
+                text += c;
+            } else if (byte < 0x20 || byte == 0x7f) {
+                snprintf(buffer, sizeof(buffer), "\\u%04x", byte);
+                text += buffer;
+            } else {
+                text += c;
+            }
+        }
+        snprintf(buffer, sizeof(buffer), "%.6f", frame.time / 1e9);
+        output << '[' << buffer << ", \"o\", \"" << text << "\"]\n";
+    }
+    return (bool) output;
+}
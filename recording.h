@@ -0,0 +1,121 @@
+/*---------------------------------------------------------------------------*\
+ *  recording.h                                                              *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the SessionRecorder class, which records what an animation sends *
+ *    to the terminal in a compact file, and the RecordingReader class,      *
+ *    which plays such a file back.                                          *
+ *  The recorder is handed the bytes of each frame as they are sent.  It     *
+ *    only copies them into a queue, with the tick and the time; a thread of *
+ *    its own does the rest and writes them out, so recording costs the      *
+ *    animation little more than a memcpy per frame.  That thread keeps a    *
+ *    model of the screen by following the bytes.  Most frames are written   *
+ *    as they were sent, as changes to the frame before (deltas).  Every so  *
+ *    often a frame is instead written whole, from the model, as a keyframe  *
+ *    that can be shown without anything before it.                          *
+ *  When the recording is closed, an index of the keyframes, by time, is     *
+ *    added to the end of the file.  The reader uses it to seek to any time  *
+ *    with a binary search: it starts from the last keyframe at or before    *
+ *    that time, and the deltas after it bring the screen up to date.  A     *
+ *    recording that was never closed has no index, so the reader builds     *
+ *    one by reading through the file, stopping at the last whole frame.     *
+ *  The reader can also write a recording out in the asciicast v2 format,    *
+ *    as used by asciinema, so that it can be shared and played elsewhere.   *
+\*---------------------------------------------------------------------------*/
+#ifndef RECORDING_H_
+#define RECORDING_H_
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "image.h"
+
+//  One frame of a recording, as handed out by RecordingReader::next().
+struct RecordedFrame
+{
+    uint64_t tick;                      // The animation's tick when it was
+    int64_t time;                       //   sent, and when, in nanoseconds
+    bool key;                           //   from the start of the recording
+    std::string_view bytes;
+};
+
+//  One entry of a recording's index: where a keyframe is, and its time.
+struct RecordingKey
+{
+    int64_t time;
+    uint64_t offset;
+};
+
+class SessionRecorder
+{
+public:
+    SessionRecorder(void);
+    ~SessionRecorder(void);
+
+    bool open(char const *name, unsigned height, unsigned width,
+              unsigned fps, std::string *error);
+    bool is_open(void) const;
+    void record(unsigned long tick, char const *bytes, size_t size);
+    bool close(std::string *error);
+    void print_stats(std::ostream &output) const;
+
+private:
+    SessionRecorder(SessionRecorder const &);
+    SessionRecorder &operator=(SessionRecorder const &);
+    void write_loop(void);
+    void follow(char const *bytes, size_t size);
+    bool write_out(void const *bytes, size_t size);
+
+    int fd;
+    unsigned fps;
+    long long start;
+    uint64_t position;                  // Where the next frame will go
+    std::mutex lock;
+    std::condition_variable wake, drained;
+    std::string pending;                // Frames waiting to be written
+    std::thread writer;
+    bool stopping, failed;
+
+    //  Only used by the writer thread until it has been joined.
+    Image<char> screen;
+    unsigned cursor_row, cursor_col;
+    std::vector<RecordingKey> index;
+    size_t since_key;                   // Delta bytes since the keyframe
+    unsigned frames_since_key;
+    unsigned long frames, keyframes;
+    uint64_t bytes_in;
+};
+
+
+class RecordingReader
+{
+public:
+    RecordingReader(void);
+    ~RecordingReader(void);
+
+    bool open(char const *name, std::string *error);
+    unsigned get_height(void) const;
+    unsigned get_width(void) const;
+    unsigned get_fps(void) const;
+
+    void seek(int64_t time);
+    bool next(RecordedFrame *frame);
+    bool write_asciicast(std::ostream &output);
+
+private:
+    RecordingReader(RecordingReader const &);
+    RecordingReader &operator=(RecordingReader const &);
+    void build_index(void);
+
+    char const *base;
+    uint64_t size, first, end, position;
+    unsigned height, width, fps;
+    std::vector<RecordingKey> keys;
+};
+
+#endif
@@ -0,0 +1,417 @@
+/*---------------------------------------------------------------------------*\
+ *  scene_file.cpp                                                           *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the SceneFile class, and the layout of the       *
+ *    records in a compiled scene.  All offsets are in bytes from the start  *
+ *    of the file.                                                           *
+\*---------------------------------------------------------------------------*/
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scene_file.h"
+using namespace std;
+
+static const char MAGIC[8] = "ANIMSCN";
+static const uint32_t VERSION = 1;
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t canvas_height, canvas_width;       // 0 if no CANVAS was given
+    uint32_t fps;                               // 0 if no FPS was given
+    uint32_t num_sprites, list_length, num_frames;
+    uint64_t sprite_table, frame_list, frame_table, file_size;
+};
+
+struct SpriteRecord
+{
+    double row_pos, col_pos, v_speed, h_speed, frame_rate, current_frame;
+    uint32_t height, width;
+    uint32_t first, count;                      // Part of the frame list
+    int32_t layer;
+    uint8_t transparent;
+    char key;
+    uint8_t padding[2];
+};
+
+struct FrameRecord
+{
+    uint64_t pixels, spans, row_starts;
+    uint32_t height, width;
+    uint32_t num_spans;
+    uint8_t transparent;
+    char key;
+    uint8_t opaque;
+    uint8_t padding;
+};
+
+static_assert(sizeof(Span) == 2 * sizeof(uint32_t),
+              "Spans are stored in scene files as they are in memory");
+
+
+/*  align()
+ *  Purpose:  A helper function that rounds an offset up to a multiple of 8,
+ *            so that every record can be read in place.
+ */
+static uint64_t align(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+
+/*  write_at()
+ *  Purpose:  A helper function that writes the given bytes at the given
+ *            offset, padding with zeros from the current position.
+ */
+static void write_at(ofstream &output, uint64_t *position, uint64_t offset,
+                     void const *bytes, size_t length)
+{
+    static const char zeros[8] = { 0 };
+    while (*position < offset) {
+        unsigned gap = min(offset - *position, (uint64_t) sizeof(zeros));
+        output.write(zeros, gap);
+        *position += gap;
+    }
+    output.write((char const *) bytes, length);
+    *position += length;
+}
+
+
+/*  fits()
+ *  Purpose:  A helper function that checks whether count items of the given
+ *            size, starting at offset, lie inside a file of the given size.
+ */
+static bool fits(uint64_t offset, uint64_t count, uint64_t size,
+                 uint64_t file_size)
+{
+    if (offset > file_size) return false;
+    return count <= (file_size - offset) / (size == 0 ? 1 : size);
+}
+
+
+/*  is_scene_file()
+ *  Purpose:  Returns whether the named file starts like a compiled scene.
+ */
+bool SceneFile::is_scene_file(char const *name)
+{
+    char magic[sizeof(MAGIC)];
+    ifstream input(name, ios::binary);
+    return input.read(magic, sizeof(magic)) &&
+           memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+
+/*  write()
+ *  Purpose:  Compiles the given canvas size, frame rate and sprites into a
+ *            scene file.
+ *  Parameters: The name of the file to write.  The canvas size, or 0 by 0
+ *            if none was given.  The frame rate, or 0 if none was given.
+ *            The sprites.  A string to describe any error in.
+ *  Returns:  True if the whole file was written.
+ *  Notes:  - Frames are written once each, however many sprites use them,
+ *            so sprites read through a FrameAtlas keep sharing them.
+ */
+bool SceneFile::write(char const *name, unsigned height, unsigned width,
+                      unsigned fps, vector<Sprite> const &sprites,
+                      string *error)
+{
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.canvas_height = height;
+    header.canvas_width = width;
+    header.fps = fps;
+    header.num_sprites = sprites.size();
+
+    //  Number the distinct frames, and lay out the tables and the blob.
+    vector<Frame const *> distinct;
+    vector<uint32_t> list;
+    unordered_map<Frame const *, uint32_t> numbers;
+    for (unsigned s = 0; s < sprites.size(); ++s) {
+        vector<FrameHandle> const &frames = sprites[s].frames;
+        for (unsigned f = 0; f < frames.size(); ++f) {
+            auto found = numbers.find(frames[f].get());
+            if (found == numbers.end()) {
+                found = numbers.insert(make_pair(frames[f].get(),
+                                                 distinct.size())).first;
+                distinct.push_back(frames[f].get());
+            }
+            list.push_back(found->second);
+        }
+    }
+    header.list_length = list.size();
+    header.num_frames = distinct.size();
+    header.sprite_table = align(sizeof(header));
+    header.frame_list = align(header.sprite_table +
+                              sprites.size() * sizeof(SpriteRecord));
+    header.frame_table = align(header.frame_list +
+                               list.size() * sizeof(uint32_t));
+    uint64_t end = header.frame_table + distinct.size() * sizeof(FrameRecord);
+    vector<FrameRecord> records(distinct.size());
+    for (unsigned f = 0; f < distinct.size(); ++f) {
+        Frame const &frame = *distinct[f];
+        FrameRecord &record = records[f];
+        memset(&record, 0, sizeof(record));
+        record.height = frame.get_height();
+        record.width = frame.get_width();
+        record.transparent = frame.has_key();
+        record.key = frame.get_key();
+        record.opaque = frame.is_opaque();
+        record.pixels = align(end);
+        end = record.pixels + (uint64_t) record.height * record.width;
+        if (!frame.is_opaque()) {
+            record.num_spans = frame.get_row_starts()[record.height];
+            record.row_starts = align(end);
+            record.spans = align(record.row_starts +
+                                 (record.height + 1) * sizeof(uint32_t));
+            end = record.spans + record.num_spans * sizeof(Span);
+        }
+    }
+    header.file_size = end;
+
+    ofstream output(name, ios::binary | ios::trunc);
+    if (!output.is_open()) {
+        *error = "could not open the file for writing";
+        return false;
+    }
+    uint64_t position = 0;
+    write_at(output, &position, 0, &header, sizeof(header));
+    uint32_t first = 0;
+    for (unsigned s = 0; s < sprites.size(); ++s) {
+        Sprite const &spr = sprites[s];
+        SpriteRecord record;
+        memset(&record, 0, sizeof(record));
+        record.row_pos = spr.row_pos;
+        record.col_pos = spr.col_pos;
+        record.v_speed = spr.v_speed;
+        record.h_speed = spr.h_speed;
+        record.frame_rate = spr.frame_rate;
+        record.current_frame = spr.current_frame;
+        record.height = spr.height;
+        record.width = spr.width;
+        record.first = first;
+        record.count = spr.frames.size();
+        record.layer = spr.layer;
+        record.transparent = spr.transparent;
+        record.key = spr.transparent_key;
+        write_at(output, &position,
+                 header.sprite_table + s * sizeof(SpriteRecord),
+                 &record, sizeof(record));
+        first += record.count;
+    }
+    write_at(output, &position, header.frame_list, list.data(),
+             list.size() * sizeof(uint32_t));
+    write_at(output, &position, header.frame_table, records.data(),
+             records.size() * sizeof(FrameRecord));
+    for (unsigned f = 0; f < distinct.size(); ++f) {
+        Frame const &frame = *distinct[f];
+        FrameRecord const &record = records[f];
+        for (unsigned r = 0; r < record.height; ++r) {
+            write_at(output, &position,
+                     record.pixels + (uint64_t) r * record.width,
+                     frame.row(r), record.width);
+        }
+        if (!frame.is_opaque()) {
+            write_at(output, &position, record.row_starts,
+                     frame.get_row_starts(),
+                     (record.height + 1) * sizeof(uint32_t));
+            write_at(output, &position, record.spans, frame.get_spans(),
+                     record.num_spans * sizeof(Span));
+        }
+    }
+    output.close();
+    if (!output) {
+        *error = "could not write the whole file";
+        return false;
+    }
+    return true;
+}
+
+
+/*  check_frame()
+ *  Purpose:  A helper function that checks that a frame record lies inside
+ *            the file, and that its spans stay inside its picture, so that
+ *            drawing it can never read or write out of bounds.
+ */
+static bool check_frame(FrameRecord const &record, char const *base,
+                        uint64_t file_size)
+{
+    uint64_t cells = (uint64_t) record.height * record.width;
+    if (!fits(record.pixels, cells, 1, file_size)) return false;
+    if (!record.transparent || record.opaque) return true;
+    if (record.row_starts % 4 != 0 || record.spans % 4 != 0 ||
+        !fits(record.row_starts, record.height + 1ULL, sizeof(uint32_t),
+              file_size) ||
+        !fits(record.spans, record.num_spans, sizeof(Span), file_size)) {
+        return false;
+    }
+    uint32_t const *starts = (uint32_t const *) (base + record.row_starts);
+    Span const *spans = (Span const *) (base + record.spans);
+    if (starts[0] != 0 || starts[record.height] != record.num_spans) {
+        return false;
+    }
+    for (unsigned r = 0; r < record.height; ++r) {
+        if (starts[r] > starts[r + 1]) return false;
+    }
+    for (unsigned s = 0; s < record.num_spans; ++s) {
+        if (spans[s].col > record.width ||
+            spans[s].length > record.width - spans[s].col) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*  load()
+ *  Purpose:  Reads a compiled scene, adding its sprites to the vector and
+ *            setting the canvas size and frame rate if it has them.
+ *  Parameters: The name of the file.  A pointer to the vector of sprites.
+ *            Pointers to the canvas height and width, which may be
+ *            modified.  A pointer to the frame rate, set to 0 if the scene
+ *            has none.  The atlas
+ *            any frames the sprites make later should be shared through.  A
+ *            string to describe any error in.
+ *  Returns:  True if successful.  On failure, nothing has been changed.
+ *  Notes:  - The frames draw from the mapped file itself.  Only the tables
+ *            and the spans are read while loading, to check them; pictures
+ *            are not touched until they are drawn.
+ *          - Frames from the file are already distinct, so they are not
+ *            put through the atlas.
+ */
+bool SceneFile::load(char const *name, vector<Sprite> *sprites,
+                     unsigned *height, unsigned *width, unsigned *fps,
+                     FrameAtlas *atlas, string *error)
+{
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        *error = "could not open the file";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (uint64_t) info.st_size < sizeof(Header)) {
+        close(fd);
+        *error = "the file is too short to be a compiled scene";
+        return false;
+    }
+    uint64_t file_size = info.st_size;
+    void *mapped = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        *error = "could not map the file into memory";
+        return false;
+    }
+    shared_ptr<void const> backing(mapped, [file_size](void const *start) {
+        munmap(const_cast<void *>(start), file_size);
+    });
+    char const *base = (char const *) mapped;
+
+    Header const &header = *(Header const *) base;
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        *error = "the file is not a compiled scene";
+        return false;
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        *error = "the scene was compiled on a machine with another byte order";
+        return false;
+    }
+    if (header.version != VERSION) {
+        *error = "the scene was compiled for another version of the format";
+        return false;
+    }
+    if (header.file_size != file_size ||
+        header.sprite_table % 8 != 0 || header.frame_list % 4 != 0 ||
+        header.frame_table % 8 != 0 ||
+        !fits(header.sprite_table, header.num_sprites, sizeof(SpriteRecord),
+              file_size) ||
+        !fits(header.frame_list, header.list_length, sizeof(uint32_t),
+              file_size) ||
+        !fits(header.frame_table, header.num_frames, sizeof(FrameRecord),
+              file_size)) {
+        *error = "the scene's tables do not fit in the file";
+        return false;
+    }
+
+    FrameRecord const *frame_table =
+        (FrameRecord const *) (base + header.frame_table);
+    vector<FrameHandle> frames(header.num_frames);
+    for (unsigned f = 0; f < header.num_frames; ++f) {
+        FrameRecord const &record = frame_table[f];
+        if (!check_frame(record, base, file_size)) {
+            *error = "frame " + to_string(f) + " is damaged";
+            return false;
+        }
+        FrameData data;
+        data.pixels = base + record.pixels;
+        data.height = record.height;
+        data.width = record.width;
+        data.transparent = record.transparent;
+        data.key = record.key;
+        data.opaque = record.opaque;
+        data.spans = (Span const *) (base + record.spans);
+        data.row_start = (unsigned const *) (base + record.row_starts);
+        frames[f] = make_shared<Frame const>(Frame(data, backing));
+    }
+
+    uint32_t const *list = (uint32_t const *) (base + header.frame_list);
+    SpriteRecord const *sprite_table =
+        (SpriteRecord const *) (base + header.sprite_table);
+    vector<Sprite> loaded;
+    loaded.reserve(header.num_sprites);
+    for (unsigned s = 0; s < header.num_sprites; ++s) {
+        SpriteRecord const &record = sprite_table[s];
+        bool valid = record.first <= header.list_length &&
+                     record.count <= header.list_length - record.first &&
+                     isfinite(record.row_pos) && isfinite(record.col_pos) &&
+                     isfinite(record.v_speed) && isfinite(record.h_speed) &&
+                     isfinite(record.frame_rate) &&
+                     record.current_frame >= 0 &&
+                     record.current_frame < max(record.count, 1u);
+        Sprite spr(atlas);
+        for (unsigned f = 0; valid && f < record.count; ++f) {
+            uint32_t number = list[record.first + f];
+            valid = number < header.num_frames &&
+                    frames[number]->get_height() == record.height &&
+                    frames[number]->get_width() == record.width;
+            if (valid) spr.frames.push_back(frames[number]);
+        }
+        if (!valid) {
+            *error = "sprite " + to_string(s) + " is damaged";
+            return false;
+        }
+        spr.height = record.height;
+        spr.width = record.width;
+        spr.row_pos = record.row_pos;
+        spr.col_pos = record.col_pos;
+        spr.v_speed = record.v_speed;
+        spr.h_speed = record.h_speed;
+        spr.frame_rate = record.frame_rate;
+        spr.current_frame = record.current_frame;
+        spr.transparent = record.transparent;
+        spr.transparent_key = record.key;
+        spr.layer = record.layer;
+        loaded.push_back(std::move(spr));
+    }
+
+    if (header.canvas_height != 0 && header.canvas_width != 0) {
+        *height = header.canvas_height;
+        *width = header.canvas_width;
+    }
+    *fps = header.fps;
+    for (unsigned s = 0; s < loaded.size(); ++s) {
+        sprites->push_back(std::move(loaded[s]));
+    }
+    return true;
+}
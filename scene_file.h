@@ -0,0 +1,44 @@
+/*---------------------------------------------------------------------------*\
+ *  scene_file.h                                                             *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the SceneFile class, which writes and reads compiled scenes: a   *
+ *    binary form of the CANVAS, FPS and SPRITE information in animation     *
+ *    files, laid out so it can be drawn from without being parsed.          *
+ *  A compiled scene is made of, in order:                                   *
+ *    - a header, with a magic string, the format version, the canvas size,  *
+ *      the frame rate, and where the tables below are;                      *
+ *    - the sprite table, one record per sprite with its position, speeds,   *
+ *      frame rate, layer and transparency, and which frames it uses;        *
+ *    - the frame list, the frame number of each frame of each sprite;       *
+ *    - the frame table, one record per distinct frame, pointing into        *
+ *    - the frame blob, which holds every frame's picture as contiguous rows *
+ *      and, for transparent frames, its spans, just as Frame draws them.    *
+ *  Loading maps the file into memory and makes Frames that draw straight    *
+ *    from it, so no picture is copied.  The mapping stays until the last    *
+ *    Frame using it is gone.                                                *
+ *  Numbers are stored in the byte order of the machine that compiled the    *
+ *    scene.  The header records that order, and a file from a machine with  *
+ *    another is refused rather than misread.                                *
+\*---------------------------------------------------------------------------*/
+#ifndef SCENE_FILE_H_
+#define SCENE_FILE_H_
+#include <string>
+#include <vector>
+#include "image.h"
+#include "sprite.h"
+#include "frame_atlas.h"
+
+class SceneFile
+{
+public:
+    static bool is_scene_file(char const *name);
+    static bool write(char const *name, unsigned height, unsigned width,
+                      unsigned fps, std::vector<Sprite> const &sprites,
+                      std::string *error);
+    static bool load(char const *name, std::vector<Sprite> *sprites,
+                     unsigned *height, unsigned *width, unsigned *fps,
+                     FrameAtlas *atlas, std::string *error);
+};
+
+#endif
@@ -0,0 +1,452 @@
+/*---------------------------------------------------------------------------*\
+ *  scene_parser.cpp                                                         *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the SceneParser class.                           *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scene_parser.h"
+#include "frame_cache.h"
+using namespace std;
+
+//  How much of a mapped file is read past before its pages are dropped.
+static const size_t RELEASE_CHUNK = 1 << 20;
+
+
+/*  is_space()
+ *  Purpose:  A helper function that says whether a character separates
+ *            words, as isspace() would in the "C" locale.
+ */
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' ||
+           c == '\f';
+}
+
+
+/*  Constructor takes the text to parse, which must stay alive, unchanged, as
+ *    long as the parser and any words it has handed out.
+ */
+SceneParser::SceneParser(string_view text)
+{
+    begin = next = text.data();
+    end = text.data() + text.size();
+    line = 1;
+    cache = NULL;
+    cache_file = 0;
+    cache_added = false;
+    lazy = false;
+    mapped = false;
+    released = begin;
+}
+
+
+/*  next_word()
+ *  Purpose:  Finds the next word: the next run of characters that are not
+ *            white space, on this line or a later one.
+ *  Returns:  False if the text has run out, or the parser has failed.
+ */
+bool SceneParser::next_word(string_view *word)
+{
+    if (failed()) return false;
+    while (next != end && is_space(*next)) {
+        if (*next == '\n') ++line;
+        ++next;
+    }
+    if (next == end) return false;
+    char const *start = next;
+    while (next != end && !is_space(*next)) ++next;
+    *word = string_view(start, next - start);
+    return true;
+}
+
+
+/*  read_number()
+ *  Purpose:  Reads the next word as a number.
+ *  Returns:  False, after failing with a message, if there is no next word
+ *            or it is not entirely a number of the right kind.
+ */
+bool SceneParser::read_number(unsigned *value)
+{
+    return read_value(value, "a whole number");
+}
+
+bool SceneParser::read_number(int *value)
+{
+    return read_value(value, "a whole number");
+}
+
+bool SceneParser::read_number(unsigned long *value)
+{
+    return read_value(value, "a whole number");
+}
+
+bool SceneParser::read_number(double *value)
+{
+    return read_value(value, "a number");
+}
+
+
+/*  read_value()
+ *  Purpose:  A helper function that does the work of read_number() for any
+ *            kind of number from_chars() can read.
+ *  Notes:  - from_chars() does not take a leading plus sign, but >> does, so
+ *            one is skipped here.
+ */
+template <typename Number>
+bool SceneParser::read_value(Number *value, char const *what)
+{
+    if (failed()) return false;
+    string_view word;
+    if (!next_word(&word)) {
+        return fail(string("expected ") + what + ", but the file ended");
+    }
+    char const *first = word.data();
+    char const *last = word.data() + word.size();
+    if (*first == '+' && last - first > 1) ++first;
+    from_chars_result result = from_chars(first, last, *value);
+    if (result.ec != errc() || result.ptr != last) {
+        return fail(string("expected ") + what + ", not \"" +
+                    string(word) + "\"");
+    }
+    return true;
+}
+
+
+/*  rest_of_line()
+ *  Purpose:  A helper function that returns everything up to the end of the
+ *            current line, without the newline, and moves on to the start
+ *            of the next line.
+ */
+string_view SceneParser::rest_of_line(void)
+{
+    char const *start = next;
+    char const *newline = (char const *) memchr(next, '\n', end - next);
+    if (newline == NULL) {
+        next = end;
+        return string_view(start, end - start);
+    }
+    next = newline + 1;
+    ++line;
+    return string_view(start, newline - start);
+}
+
+
+/*  read_sprite()
+ *  Purpose:  Reads the information for one sprite, which follows the word
+ *            SPRITE, into the given sprite.
+ *  Returns:  False, after failing with a message, if any of it is missing
+ *            or invalid.  The sprite may then be partly filled in.
+ *  Notes:  - Reads exactly what Sprite::read_in() does, in the same way: the
+ *            numbers, then attributes on the rest of their line, then each
+ *            frame, a line per row, with read_rows().
+ *          - When the parser is lazy, each frame's rows are skipped over and
+ *            indexed in the FrameCache instead.  The sprite then draws its
+ *            frames through the cache.  The file is added to the cache
+ *            when the first frame is indexed, so a file read in full is
+ *            never added.
+ */
+bool SceneParser::read_sprite(Sprite *spr)
+{
+    unsigned h, w, num_frames;
+    double r, c, v_s, h_s, frames_per_cycle;
+    if (!read_number(&h) || !read_number(&w) || !read_number(&r) ||
+        !read_number(&c)) {
+        return false;
+    }
+    if (r < 0 || c < 0) {
+        return fail("a sprite's starting position may not be negative");
+    }
+    if (!read_number(&v_s) || !read_number(&h_s) ||
+        !read_number(&num_frames) || !read_number(&frames_per_cycle)) {
+        return false;
+    }
+    read_attributes(rest_of_line(), spr);
+    spr->set_height(h);
+    spr->set_width(w);
+    spr->row_pos = r;
+    spr->col_pos = c;
+    spr->v_speed = v_s;
+    spr->h_speed = h_s;
+    spr->frame_rate = (frames_per_cycle == 0) ? 0
+                      : num_frames / frames_per_cycle;
+    for (unsigned f = 0; f < num_frames; ++f) {
+        if (next == end) {
+            return fail("the file ended before frame " + to_string(f + 1) +
+                        " of " + to_string(num_frames));
+        }
+        if (lazy && cache != NULL) {
+            if (!cache_added) {
+                cache_file = cache->add_file(cache_name);
+                cache_added = true;
+            }
+            char const *start = next;
+            for (unsigned row = 0; row < h; ++row) rest_of_line();
+            spr->cache = cache;
+            spr->cached_frames.push_back(
+                cache->add_frame(cache_file, start - begin, next - start, h,
+                                 w, spr->transparent, spr->transparent_key));
+            release_behind();
+            continue;
+        }
+        Image<char> frame(h, w);
+        frame.set_all(' ');
+        read_rows(&frame);
+        spr->add_frame(std::move(frame));
+        release_behind();
+    }
+    return true;
+}
+
+
+/*  read_rows()
+ *  Purpose:  Reads one frame's picture into the given image, a line per row
+ *            of the image.
+ *  Notes:  - Rows that are too short are left as they were in the image, so
+ *            it should be filled with spaces first.  Rows that are too long
+ *            are cut short.  If the text runs out, the rest of the rows are
+ *            left as they were too.
+ */
+void SceneParser::read_rows(Image<char> *frame)
+{
+    unsigned width = frame->get_width();
+    for (unsigned row = 0; row < frame->get_height(); ++row) {
+        string_view cells = rest_of_line();
+        size_t length = min(cells.size(), (size_t) width);
+        copy(cells.data(), cells.data() + length, frame->row_unchecked(row));
+    }
+}
+
+
+/*  set_frame_cache()
+ *  Purpose:  Gives the parser a cache to index frames in when it is lazy,
+ *            and the name of the file being parsed, to add to the cache if
+ *            any frames are indexed.
+ *  Notes:  - The text given to the parser must be the whole file, since the
+ *            cache finds frames by where they are from its start.
+ */
+void SceneParser::set_frame_cache(FrameCache *frame_cache,
+                                  string const &file)
+{
+    cache = frame_cache;
+    cache_name = file;
+    cache_added = false;
+}
+
+
+/*  set_lazy()
+ *  Purpose:  Sets whether sprites read from here on have their frames only
+ *            indexed, not read.  Has no effect without a frame cache.
+ */
+void SceneParser::set_lazy(bool on)
+{
+    lazy = on;
+}
+
+
+/*  set_mapped()
+ *  Purpose:  Sets whether the text is a file mapped with map_file(), whose
+ *            pages the parser may drop once it has read past them.
+ *  Notes:  - Dropped pages are read from the file again if touched, so
+ *            words handed out earlier stay valid.  Text in ordinary memory
+ *            must never be marked as mapped, or it would be lost.
+ */
+void SceneParser::set_mapped(bool on)
+{
+    mapped = on;
+}
+
+
+/*  release_behind()
+ *  Purpose:  A helper function that drops the pages of a mapped file that
+ *            the parser has read past, once there are RELEASE_CHUNK bytes
+ *            of them, so they no longer count against memory.
+ */
+void SceneParser::release_behind(void)
+{
+    if (!mapped) return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t done = (size_t) (next - begin) / page * page;
+    if (begin + done - released < (ptrdiff_t) RELEASE_CHUNK) return;
+    madvise(const_cast<char *>(released), begin + done - released,
+            MADV_DONTNEED);
+    released = begin + done;
+}
+
+
+/*  read_attributes()
+ *  Purpose:  Applies the optional attributes that may follow the numbers
+ *            on a sprite's first line.  Unrecognized words are ignored.
+ *  Notes:  - TRANSPARENT c makes the character c transparent.  If no single
+ *            character follows the word, the space is transparent.
+ *          - LAYER n puts the sprite in layer n, which may be negative.  As
+ *            with >>, a leading plus sign is taken, and the number may be
+ *            followed by other characters, which are ignored.
+ *          - This is the only attribute parser: Sprite::read_in() uses it
+ *            too, so a file means the same read either way.
+ */
+void SceneParser::read_attributes(string_view text, Sprite *spr)
+{
+    SceneParser words(text);
+    string_view word, after;
+    bool have_word = words.next_word(&word);
+    while (have_word) {
+        bool have_after = words.next_word(&after);
+        if (same_word(word, "TRANSPARENT")) {
+            if (have_after && after.size() == 1) {
+                spr->set_transparent(after[0]);
+                have_after = words.next_word(&after);
+            } else {
+                spr->set_transparent(' ');
+            }
+        } else if (same_word(word, "LAYER") && have_after) {
+            int l = 0;
+            char const *first = after.data();
+            char const *last = after.data() + after.size();
+            if (*first == '+' && last - first > 1 && first[1] != '-') {
+                ++first;
+            }
+            from_chars_result result = from_chars(first, last, l);
+            if (result.ptr != first && result.ec == errc()) {
+                spr->set_layer(l);
+            }
+            have_after = words.next_word(&after);
+        }
+        word = after;
+        have_word = have_after;
+    }
+}
+
+
+/*  fail()
+ *  Purpose:  Stops the parser, recording the given message and the current
+ *            line.  Only the first failure is kept.
+ *  Returns:  False, so callers can return its result directly.
+ */
+bool SceneParser::fail(string const &message)
+{
+    if (!failed()) {
+        error = "line " + to_string(line) + ": " + message;
+    }
+    return false;
+}
+
+
+/*  failed()
+ *  Purpose:  Returns whether the parser has stopped on an error.
+ */
+bool SceneParser::failed(void) const
+{
+    return !error.empty();
+}
+
+
+/*  get_error()
+ *  Purpose:  Returns the message of the error the parser stopped on, which
+ *            starts with its line number, or an empty string.
+ */
+string const &SceneParser::get_error(void) const
+{
+    return error;
+}
+
+
+/*  get_line()
+ *  Purpose:  Returns the number of the line the parser is on, from 1.
+ */
+unsigned SceneParser::get_line(void) const
+{
+    return line;
+}
+
+
+/*  same_word()
+ *  Purpose:  Checks whether a word is the given upper-case word, ignoring
+ *            the case of the first.  Nothing is copied.
+ */
+bool SceneParser::same_word(string_view word, char const *upper)
+{
+    size_t length = strlen(upper);
+    if (word.size() != length) return false;
+    for (size_t i = 0; i < length; ++i) {
+        if (toupper((unsigned char) word[i]) != upper[i]) return false;
+    }
+    return true;
+}
+
+
+/*  read_file()
+ *  Purpose:  Reads the whole of the named file into the given string.
+ *  Returns:  False if the file could not be opened or read.
+ *  Notes:  - The string is sized from the file's size first, so a regular
+ *            file is normally read with a single read().  Files whose size
+ *            is not known in advance, such as pipes, are read until they end.
+ */
+bool SceneParser::read_file(char const *name, string *contents)
+{
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    size_t expected = (fstat(fd, &info) == 0) ? info.st_size : 0;
+    contents->resize(expected + 1);
+    size_t done = 0;
+    for (;;) {
+        if (done == contents->size()) contents->resize(done * 2 + 4096);
+        ssize_t got = read(fd, &(*contents)[done], contents->size() - done);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            close(fd);
+            return false;
+        }
+        if (got == 0) break;
+        done += got;
+    }
+    close(fd);
+    contents->resize(done);
+    return true;
+}
+
+
+/*  map_file()
+ *  Purpose:  Maps the whole of the named file into memory, read only.
+ *  Parameters: The name of the file.  A pointer to where to put its size.
+ *  Returns:  The start of the file's text, or NULL if it could not be
+ *            mapped: if it could not be opened, is empty, or is not a
+ *            regular file, such as a pipe.  read_file() reads those.
+ *  Notes:  - The text must be given back with unmap_file().
+ */
+char const *SceneParser::map_file(char const *name, size_t *size)
+{
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat info;
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *text = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) return NULL;
+    madvise(text, info.st_size, MADV_SEQUENTIAL);
+    *size = info.st_size;
+    return (char const *) text;
+}
+
+
+/*  unmap_file()
+ *  Purpose:  Gives back text mapped by map_file().  Does nothing if it is
+ *            NULL.
+ */
+void SceneParser::unmap_file(char const *text, size_t size)
+{
+    if (text != NULL) munmap(const_cast<char *>(text), size);
+}
@@ -0,0 +1,77 @@
+/*---------------------------------------------------------------------------*\
+ *  scene_parser.h                                                           *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the SceneParser class, which reads the text format of animation  *
+ *    files out of a buffer holding the whole file.                          *
+ *  Words are handed out as string_views into the buffer, so reading them    *
+ *    allocates nothing.  Numbers are converted with std::from_chars, which  *
+ *    ignores the locale, and each row of a frame is copied straight from    *
+ *    the buffer into the frame's image.                                     *
+ *  The parser counts lines as it goes.  When something cannot be read, it   *
+ *    stops and remembers what went wrong and on which line, for get_error().*
+ *  What the words mean is left to the caller, except for the SPRITE entry   *
+ *    itself, which read_sprite() reads in the same way Sprite::read_in()    *
+ *    does.                                                                  *
+ *  Given a FrameCache and the file the text came from, the parser can be    *
+ *    made lazy: read_sprite() then only indexes where each frame is in the  *
+ *    file, and the frames are read later, through the cache, when drawn.    *
+ *  A file can be mapped into memory with map_file() instead of being read.  *
+ *    The parser is then told with set_mapped() that it may drop the pages   *
+ *    it has read past, so that however large the file, only a little of it  *
+ *    is held at once.  Lazy sprites then cost no more than their index.     *
+\*---------------------------------------------------------------------------*/
+#ifndef SCENE_PARSER_H_
+#define SCENE_PARSER_H_
+#include <string>
+#include <string_view>
+#include "sprite.h"
+
+class FrameCache;
+
+class SceneParser
+{
+public:
+    SceneParser(std::string_view text);
+
+    bool next_word(std::string_view *word);
+    bool read_number(unsigned *value);
+    bool read_number(int *value);
+    bool read_number(unsigned long *value);
+    bool read_number(double *value);
+    bool read_sprite(Sprite *spr);
+    void read_rows(Image<char> *frame);
+    void set_frame_cache(FrameCache *frame_cache, std::string const &file);
+    void set_lazy(bool on);
+    void set_mapped(bool on);
+
+    bool fail(std::string const &message);
+    bool failed(void) const;
+    std::string const &get_error(void) const;
+    unsigned get_line(void) const;
+
+    static bool same_word(std::string_view word, char const *upper);
+    static bool read_file(char const *name, std::string *contents);
+    static char const *map_file(char const *name, size_t *size);
+    static void unmap_file(char const *text, size_t size);
+    static void read_attributes(std::string_view line, Sprite *spr);
+
+private:
+    template <typename Number>
+    bool read_value(Number *value, char const *what);
+    std::string_view rest_of_line(void);
+    void release_behind(void);
+
+    char const *begin, *next, *end;
+    unsigned line;
+    std::string error;
+    FrameCache *cache;
+    std::string cache_name;
+    unsigned cache_file;
+    bool cache_added;                   // Whether the file is in the cache
+    bool lazy;
+    bool mapped;
+    char const *released;               // Pages before this were dropped
+};
+
+#endif
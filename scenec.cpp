@@ -0,0 +1,90 @@
+/*---------------------------------------------------------------------------*\
+ *  scenec.cpp                                                               *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  The scene compiler: turns animation files into one compiled scene file,  *
+ *    which the animation program can load much faster.  See scene_file.h    *
+ *    for what a compiled scene holds.                                       *
+ *                                                                           *
+ *  Usage:  scenec.out output-file input-file...                             *
+ *    The input files are read in order, just as the animation program       *
+ *    would read them, and everything is written to the output file.  Only   *
+ *    CANVAS, FPS and SPRITE are compiled; other directives are program      *
+ *    options, and are ignored.                                              *
+\*---------------------------------------------------------------------------*/
+#include <iostream>
+#include <string>
+#include <vector>
+#include "image.h"
+#include "sprite.h"
+#include "frame_atlas.h"
+#include "scene_file.h"
+#include "scene_parser.h"
+using namespace std;
+
+bool compile_file(SceneParser &parser, vector<Sprite> *sprites,
+                  unsigned *height, unsigned *width, unsigned *fps,
+                  FrameAtlas *atlas);
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " output-file input-file..." << endl;
+        return 1;
+    }
+    unsigned height = 0, width = 0, fps = 0;
+    FrameAtlas atlas;
+    vector<Sprite> sprites;
+    for (int i = 2; i < argc; ++i) {
+        string text;
+        if (!SceneParser::read_file(argv[i], &text)) {
+            cerr << "Could not open file \"" << argv[i] << "\"" << endl;
+            return 1;
+        }
+        SceneParser parser(text);
+        if (!compile_file(parser, &sprites, &height, &width, &fps, &atlas)) {
+            cerr << argv[i] << ", " << parser.get_error() << endl;
+            return 1;
+        }
+    }
+    string error;
+    if (!SceneFile::write(argv[1], height, width, fps, sprites, &error)) {
+        cerr << "Could not write \"" << argv[1] << "\": " << error << endl;
+        return 1;
+    }
+    cerr << "Compiled " << sprites.size() << " sprites with " << atlas.size()
+         << " distinct frames into \"" << argv[1] << "\"" << endl;
+    return 0;
+}
+
+
+/*  compile_file()
+ *  Purpose:  Reads the CANVAS, FPS and SPRITE information through the given
+ *            parser, as process_file() in the animation program does.
+ *  Parameters: The parser to read with.  Pointers to the sprites, the
+ *            canvas height and width and the frame rate, which may be
+ *            modified.  The atlas that frames are shared through.
+ *  Returns:  False if the parser stopped on an error.
+ */
+bool compile_file(SceneParser &parser, vector<Sprite> *sprites,
+                  unsigned *height, unsigned *width, unsigned *fps,
+                  FrameAtlas *atlas)
+{
+    string_view first;
+    while (parser.next_word(&first)) {
+        if (SceneParser::same_word(first, "CANVAS")) {
+            unsigned h, w;
+            if (!parser.read_number(&h) || !parser.read_number(&w)) break;
+            *height = h;
+            *width = w;
+        } else if (SceneParser::same_word(first, "SPRITE")) {
+            Sprite current(atlas);
+            if (!parser.read_sprite(&current)) break;
+            sprites->push_back(std::move(current));
+        } else if (SceneParser::same_word(first, "FPS")) {
+            parser.read_number(fps);
+        }
+    }
+    return !parser.failed();
+}
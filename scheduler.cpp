@@ -0,0 +1,145 @@
+/*---------------------------------------------------------------------------*\
+ *  scheduler.cpp                                                            *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the FrameScheduler class.  All times are in      *
+ *    nanoseconds on the monotonic clock.                                    *
+\*---------------------------------------------------------------------------*/
+#include <iostream>
+#include <poll.h>
+#include <time.h>
+#include "scheduler.h"
+using namespace std;
+
+static const long long NSECS_PER_SEC = 1000000000LL;
+
+
+/*  Constructor takes the number of frames per second to keep to, and starts
+ *    the clock: the first tick is due now.
+ */
+FrameScheduler::FrameScheduler(unsigned fps)
+{
+    period = NSECS_PER_SEC / (fps == 0 ? 1 : fps);
+    start = deadline = now();
+    ticks = presented = late = 0;
+    total_jitter = max_jitter = 0;
+    sleeps = 0;
+}
+
+
+/*  should_present()
+ *  Purpose:  Says whether the current tick should be drawn and shown.
+ *  Returns:  False if the tick's time slot has already passed, meaning the
+ *            animation has fallen behind and should only advance.
+ */
+bool FrameScheduler::should_present(void) const
+{
+    return now() < deadline + period;
+}
+
+
+/*  frame_done()
+ *  Purpose:  Records that the current tick is over, and whether it was
+ *            shown.  Moves the deadline on to the next tick.
+ */
+void FrameScheduler::frame_done(bool shown)
+{
+    ++ticks;
+    if (shown) {
+        ++presented;
+    } else {
+        ++late;
+    }
+    deadline += period;
+}
+
+
+/*  wait_for_input()
+ *  Purpose:  Sleeps until the deadline of the next tick, or until the given
+ *            file descriptor has input to read, whichever comes first.
+ *  Returns:  True if there is input; it is left for the caller to read.
+ *            False once the deadline has come.
+ *  Notes:  - A negative file descriptor is ignored, as poll() does, so this
+ *            then just sleeps.
+ */
+bool FrameScheduler::wait_for_input(int input_fd)
+{
+    if (deadline - now() <= 0) return false;
+    if (wait_until(deadline, input_fd)) return true;
+    record_wakeup();
+    return false;
+}
+
+
+/*  wait_until()
+ *  Purpose:  Sleeps until the given time on the clock of now(), or until
+ *            the given file descriptor has input to read, whichever comes
+ *            first.
+ *  Returns:  True if there is input, false once the time has come.
+ *  Notes:  - A negative file descriptor is ignored, as poll() does.
+ *          - ppoll() only takes a relative timeout, so it is worked out
+ *            again from the absolute time each time round.
+ */
+bool FrameScheduler::wait_until(long long time, int input_fd)
+{
+    struct pollfd input = { input_fd, POLLIN, 0 };
+    long long remaining = time - now();
+    while (remaining > 0) {
+        struct timespec timeout;
+        timeout.tv_sec = remaining / NSECS_PER_SEC;
+        timeout.tv_nsec = remaining % NSECS_PER_SEC;
+        if (ppoll(&input, 1, &timeout, NULL) > 0) return true;
+        remaining = time - now();
+    }
+    return false;
+}
+
+
+/*  record_wakeup()
+ *  Purpose:  A helper function that adds how late the last sleep woke up
+ *            to the statistics.
+ */
+void FrameScheduler::record_wakeup(void)
+{
+    long long jitter = now() - deadline;
+    total_jitter += jitter;
+    if (jitter > max_jitter) max_jitter = jitter;
+    ++sleeps;
+}
+
+
+/*  get_deadline()
+ *  Purpose:  Returns the time at which the next tick is due.
+ */
+long long FrameScheduler::get_deadline(void) const
+{
+    return deadline;
+}
+
+
+/*  now()
+ *  Purpose:  Returns the current time.
+ */
+long long FrameScheduler::now(void)
+{
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+    return current.tv_sec * NSECS_PER_SEC + current.tv_nsec;
+}
+
+
+/*  print_stats()
+ *  Purpose:  Prints the achieved frame rate, the number of frames skipped
+ *            for running late, and the mean and worst lateness of waking up,
+ *            on one line.
+ */
+void FrameScheduler::print_stats(ostream &output) const
+{
+    double elapsed = (double) (now() - start) / NSECS_PER_SEC;
+    output << "ticks: " << ticks
+           << "  achieved fps: " << (elapsed > 0 ? presented / elapsed : 0)
+           << "  late frames: " << late
+           << "  jitter mean/max (us): "
+           << (sleeps == 0 ? 0 : total_jitter / 1000.0 / sleeps) << "/"
+           << max_jitter / 1000.0 << endl;
+}
@@ -0,0 +1,45 @@
+/*---------------------------------------------------------------------------*\
+ *  scheduler.h                                                              *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the FrameScheduler class, which keeps an animation running at a  *
+ *    steady number of frames per second by the wall clock.                  *
+ *  Every tick has a deadline, a fixed number of periods after the start,    *
+ *    read from the monotonic clock.  Waiting sleeps until the next deadline *
+ *    itself rather than for a fixed time, so the time spent drawing and     *
+ *    reading input does not make the animation drift slower.  When drawing  *
+ *    falls more than a tick behind, the scheduler says to skip presenting   *
+ *    frames, while still advancing the simulation, until it catches up.     *
+ *  Waiting also watches a file descriptor, so that keys are noticed the     *
+ *    moment they arrive instead of once per tick.  wait_until() does the    *
+ *    same for any time on the clock, for callers with their own deadlines.  *
+ *  The scheduler also keeps statistics: the frame rate actually achieved,   *
+ *    how many frames were skipped, and how late it woke up from sleeping.   *
+\*---------------------------------------------------------------------------*/
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+#include <ostream>
+
+class FrameScheduler
+{
+public:
+    FrameScheduler(unsigned fps);
+
+    bool should_present(void) const;
+    void frame_done(bool shown);
+    bool wait_for_input(int input_fd);
+    long long get_deadline(void) const;
+
+    static long long now(void);
+    static bool wait_until(long long time, int input_fd);
+    void print_stats(std::ostream &output) const;
+
+private:
+    void record_wakeup(void);
+    long long period, start, deadline;
+    unsigned long ticks, presented, late;
+    long long total_jitter, max_jitter;
+    unsigned long sleeps;
+};
+
+#endif
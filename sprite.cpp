@@ -5,22 +5,38 @@
  *  Defines the methods for the Sprite class.                                *
 \*---------------------------------------------------------------------------*/
 #include <iostream>
-#include <cmath>
+#include <utility>
 #include "sprite.h"
+#include "frame_cache.h"
+#include "scene_parser.h"
 using namespace std;
 
 
 
-/*  Default constructor sets all values to zero.
+/*  Default constructor sets all values to zero.  Frames are not shared with
+ *    other sprites.
  */
-Sprite::Sprite(void)
+Sprite::Sprite(void) : Sprite(NULL)
 {
+}
+
+
+/*  Overloaded constructor sets all values to zero, and takes the atlas that
+ *    frames should be shared through.
+ */
+Sprite::Sprite(FrameAtlas *frame_atlas)
+{
+    atlas = frame_atlas;
     height = width = 0;
     row_pos = col_pos = 0;
     v_speed = h_speed = 0;
     frame_rate = 0;
     current_frame = 0;
-    // Default vector constructor ensures board is an empty 2-D vector
+    transparent = false;
+    transparent_key = ' ';
+    layer = 0;
+    cache = NULL;
+    // Default vector constructor ensures there are no frames
 }
 
 
@@ -34,6 +50,8 @@ Sprite::Sprite(void)
  *            horizontal speed, number of frames, and frames per animation
  *            cycle.  Then each of the frames (which is an image),
  *            one at a time.
+ *          - The first line may end with attributes, read by
+ *            SceneParser::read_attributes(), as they are from a buffer.
  *          - Lines in the image that are too short will be padded with empty
  *            characters, while lines that are too long will be truncated.
  *          - However, each frame should have exactly the expected number of
@@ -56,8 +74,9 @@ bool Sprite::read_in(istream &input)
     if (!(input >> v_s >> h_s >> num_frames >> frames_per_cycle)) {
         return false;
     }
-    getline(input, line);    // Ignore remainder of line; advance to the
-    set_height(h);           // next line in input
+    getline(input, line);    // Remainder of line holds any attributes;
+    SceneParser::read_attributes(line, this);   // reading it advances
+    set_height(h);
     set_width(w);
     row_pos = r;
     col_pos = c;
@@ -72,7 +91,7 @@ bool Sprite::read_in(istream &input)
         Image<char> next_frame(height, width);
         next_frame.set_all(' ');
         input >> next_frame;
-        add_frame(next_frame);
+        add_frame(std::move(next_frame));
     }
     return true;
 }
@@ -86,7 +105,7 @@ bool Sprite::read_in(istream &input)
  */
 void Sprite::display(std::ostream &output) const
 {
-    output << frames[current_frame];
+    output << get_frame(current_frame)->to_image();
 }
 
 
@@ -96,21 +115,43 @@ void Sprite::display(std::ostream &output) const
  */
 void Sprite::add_frame(Image<char> new_frame)
 {
-    frames.push_back(new_frame);
+    frames.push_back(make_frame(std::move(new_frame)));
 }
 
 
-/*  wrap()
- *  Purpose:  A helper function that "wraps" a given number so that it is
- *            within the given interval.
+/*  make_frame()
+ *  Purpose:  A helper function that turns an image into a frame, using the
+ *            Sprite's transparent key, and shares it through the atlas if
+ *            the Sprite has one.
  */
-static double wrap(double number, double min, double max)
+FrameHandle Sprite::make_frame(Image<char> image) const
 {
-    number = fmod(number - min, max - min);
-    if (number < 0) {
-        return number + max;
+    Frame frame = transparent ? Frame(std::move(image), transparent_key)
+                              : Frame(std::move(image));
+    if (atlas != NULL) {
+        return atlas->intern(std::move(frame));
     }
-    return min + number;
+    return std::make_shared<Frame const>(std::move(frame));
+}
+
+
+/*  frame_count()
+ *  Purpose:  A helper function that returns the number of frames in the
+ *            Sprite's cycle, whether held or in a FrameCache.
+ */
+unsigned Sprite::frame_count(void) const
+{
+    return (cache != NULL) ? cached_frames.size() : frames.size();
+}
+
+
+/*  get_frame()
+ *  Purpose:  A helper function that returns frame f of the Sprite's cycle,
+ *            reading it through the FrameCache if the Sprite uses one.
+ */
+FrameHandle Sprite::get_frame(unsigned f) const
+{
+    return (cache != NULL) ? cache->get(cached_frames[f]) : frames[f];
 }
 
 
@@ -131,9 +172,11 @@ static double wrap(double number, double min, double max)
  */
 void Sprite::advance(unsigned canvas_height, unsigned canvas_width)
 {
-    row_pos = wrap(row_pos + v_speed, 0, canvas_height);
-    col_pos = wrap(col_pos + h_speed, 0, canvas_width);
-    current_frame = wrap(current_frame + frame_rate, 0, frames.size());
+    row_pos = wrap(row_pos + v_speed, canvas_height);
+    col_pos = wrap(col_pos + h_speed, canvas_width);
+    if (frame_count() != 0) {
+        current_frame = wrap(current_frame + frame_rate, frame_count());
+    }
 }
 
 
@@ -142,18 +185,14 @@ void Sprite::advance(unsigned canvas_height, unsigned canvas_width)
  *            in the given image.
  *  Parameters: A pointer to the image to draw the Sprite in, which will be
  *            modified.
- *  Notes:  - Relies on the Image's update_at() function to handle
+ *  Notes:  - Relies on the Frame's draw_to() function to handle
  *            out-of-bounds values when the Sprite is on the edge of the board.
+ *          - Transparent characters are not drawn.
  */
 void Sprite::draw_to(Image<char> *board) const
 {
-    for (unsigned row = 0; row < height; ++row) {
-        for (unsigned col = 0; col < width; ++col) {
-            unsigned board_row = row + row_pos;
-            unsigned board_col = col + col_pos;
-            board->update_at(board_row, board_col,
-                             frames[current_frame].at(row, col));
-        }
+    if (frame_count() != 0) {
+        get_frame(current_frame)->draw_to(board, row_pos, col_pos);
     }
 }
 
@@ -164,13 +203,16 @@ void Sprite::draw_to(Image<char> *board) const
  *            truncated and characters on the bottom are lost.
  *          - If the new height is larger than the old height, the images are
  *            expanded with empty characters placed in the new positions.
+ *          - Frames in a FrameCache keep the size they were indexed with.
  */
 void Sprite::set_height(unsigned h)
 {
     if (h != height) {
         unsigned size = frames.size();
         for (unsigned f = 0; f < size; ++f) {
-            frames[f].set_height(h);
+            Image<char> resized = frames[f]->to_image();
+            resized.set_height(h);
+            frames[f] = make_frame(std::move(resized));
         }
         height = h;
     }
@@ -183,19 +225,47 @@ void Sprite::set_height(unsigned h)
  *            truncated and characters on the edge are lost.
  *          - If the new width is larger than the old width, the images are
  *            expanded with empty characters placed in the new positions.
+ *          - Frames in a FrameCache keep the size they were indexed with.
  */
 void Sprite::set_width(unsigned w)
 {
     if (w != width) {
         unsigned size = frames.size();
         for (unsigned f = 0; f < size; ++f) {
-            frames[f].set_width(w);
+            Image<char> resized = frames[f]->to_image();
+            resized.set_width(w);
+            frames[f] = make_frame(std::move(resized));
         }
         width = w;
     }
 }
 
 
+/*  set_transparent()
+ *  Purpose:  Makes the given character transparent in every frame of the
+ *            Sprite, including frames added later.
+ *  Notes:  - Frames in a FrameCache keep the key they were indexed with.
+ */
+void Sprite::set_transparent(char key)
+{
+    transparent = true;
+    transparent_key = key;
+    unsigned size = frames.size();
+    for (unsigned f = 0; f < size; ++f) {
+        frames[f] = make_frame(frames[f]->to_image());
+    }
+}
+
+
+/*  set_layer()
+ *  Purpose:  Sets the layer the Sprite is drawn in.
+ */
+void Sprite::set_layer(int l)
+{
+    layer = l;
+}
+
+
 /*  get_height()
  *  Purpose:  Returns the height of the Sprite's image frames.
  */
@@ -214,6 +284,15 @@ unsigned Sprite::get_width(void) const
 }
 
 
+/*  get_layer()
+ *  Purpose:  Returns the layer the Sprite is drawn in.
+ */
+int Sprite::get_layer(void) const
+{
+    return layer;
+}
+
+
 /*  print()
  *  Purely for debugging; prints the sprite's information to cout in a
  *    nicely formatted way that is easy to follow.
@@ -225,9 +304,9 @@ void Sprite::print() const
     cout << "Velocity: (" << v_speed << ", " << h_speed << ")" << endl;
     cout << "Frame rate: " << frame_rate << ",   current frame: "
          << current_frame << endl;
-    for (unsigned f = 0; f < frames.size(); ++f) {
+    for (unsigned f = 0; f < frame_count(); ++f) {
         cout << "============= FRAME " << f << " ===============" << endl;
-        cout << frames[f];
+        cout << get_frame(f)->to_image();
     }
     cout << "======================================" << endl;
 }
@@ -13,6 +13,15 @@
  *    frame will also change, based on the frame rate.                       *
  *    Finally, a sprite's current frame can be drawn onto another image at   *
  *    the appropriate position with the draw_to() function.                  *
+ *    A sprite may have a transparent key character, which is left undrawn   *
+ *    so that whatever is underneath the sprite shows through.  Its layer    *
+ *    decides what it is drawn over: higher layers are drawn later.          *
+ *    Frames are held through FrameHandles, so copying a sprite does not     *
+ *    copy its pictures.  Sprites made with a FrameAtlas share any frames    *
+ *    that are identical.                                                    *
+ *    A sprite read lazily holds no frames itself.  It holds the numbers of  *
+ *    its frames in a FrameCache instead, and gets each one from the cache   *
+ *    when it is drawn.                                                      *
  *                                                                           *
  * TO DO:                                                                    *
  * - Allow moving around of frames, or at least a remove() function          *
@@ -21,12 +30,18 @@
 #define SPRITE_H_
 #include <vector>
 #include <fstream>
+#include <cmath>
 #include "image.h"
+#include "frame.h"
+#include "frame_atlas.h"
+
+class FrameCache;
 
 class Sprite
 {
 public:
     Sprite(void);
+    Sprite(FrameAtlas *frame_atlas);
 
     bool read_in(std::istream &input);
     void display(std::ostream &output) const;
@@ -37,19 +52,58 @@ public:
 
     void set_height(unsigned h);
     void set_width(unsigned w);
+    void set_transparent(char key);
+    void set_layer(int l);
     unsigned get_height(void) const;
     unsigned get_width(void) const;
+    int get_layer(void) const;
 
 private:
+    friend class SpriteSystem;
+    friend class SceneFile;
+    friend class SceneParser;
+    FrameHandle make_frame(Image<char> image) const;
+    unsigned frame_count(void) const;
+    FrameHandle get_frame(unsigned f) const;
     void print() const;
     unsigned height, width;
     double row_pos, col_pos;
     double v_speed, h_speed;
     double frame_rate;
     double current_frame;
-    std::vector< Image<char> > frames;
+    bool transparent;
+    char transparent_key;
+    int layer;
+    FrameAtlas *atlas;
+    std::vector<FrameHandle> frames;
+    FrameCache *cache;
+    std::vector<unsigned> cached_frames;
 };
 
+/*  wrap()
+ *  Purpose:  A helper function that "wraps" a given number so that it is
+ *            within the interval [0, max).
+ *  Notes:  - A number that is off by less than max in either direction, as
+ *            after a single step of a sprite no faster than the canvas is
+ *            wide, is wrapped with one add or subtract.  Only larger jumps
+ *            need the division in floor().
+ *          - max must not be 0.
+ */
+inline double wrap(double number, double max)
+{
+    if (number >= max) {
+        number -= max;
+    } else if (number < 0) {
+        number += max;     // May round up to exactly max
+    }
+    if (number >= max || number < 0) {
+        number -= max * std::floor(number / max);
+        if (number >= max || number < 0) number = 0;
+    }
+    return number;
+}
+
+
 /*  >> operator provided for convenience.
  *  Calls the read_in() method, and may set the input stream's failbit if
  *    the operation fails.
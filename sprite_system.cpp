@@ -0,0 +1,565 @@
+/*---------------------------------------------------------------------------*\
+ *  sprite_system.cpp                                                        *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the SpriteSystem class.                          *
+\*---------------------------------------------------------------------------*/
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include "sprite_system.h"
+#include "frame_cache.h"
+using namespace std;
+
+//  How many of its next frames are prefetched for each lazily read sprite.
+static const unsigned PREFETCH_FRAMES = 4;
+
+//  How far from a whole number of cycles a speed may be after its period,
+//    in cycles, and still be taken as exactly a whole number.
+static const double PERIOD_TOLERANCE = 1e-9;
+
+
+/*  Default constructor makes an empty system.
+ */
+SpriteSystem::SpriteSystem(void)
+{
+    tick = period = 0;
+    cache = NULL;
+    viewport = Viewport();
+}
+
+
+/*  Overloaded constructor adds the given sprites sorted by layer, lowest
+ *    first.  Sprites in the same layer keep their order.
+ */
+SpriteSystem::SpriteSystem(vector<Sprite> const &sprites)
+{
+    tick = period = 0;
+    cache = NULL;
+    viewport = Viewport();
+    vector<unsigned> order(sprites.size());
+    for (unsigned i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+        return sprites[a].get_layer() < sprites[b].get_layer();
+    });
+    for (unsigned i = 0; i < order.size(); ++i) {
+        add(sprites[order[i]]);
+    }
+}
+
+
+/*  add()
+ *  Purpose:  Adds a copy of the given sprite to the system, to be drawn
+ *            after every sprite already added.  The sprite's frames are
+ *            shared, not copied.
+ *  Notes:  - A sprite read lazily adds empty handles to the list of frames,
+ *            and its frames' numbers in the FrameCache alongside them.  All
+ *            such sprites must use the same cache.
+ *          - The size kept for each sprite is that of its largest frame,
+ *            so that its frames need not be looked at to place it.  Lazy
+ *            frames are indexed at the sprite's size.
+ */
+void SpriteSystem::add(Sprite const &spr)
+{
+    unsigned count = spr.frame_count();
+    row_pos.push_back(spr.row_pos);
+    col_pos.push_back(spr.col_pos);
+    v_speed.push_back(spr.v_speed);
+    h_speed.push_back(spr.h_speed);
+    frame_rate.push_back(count == 0 ? 0 : spr.frame_rate);
+    current_frame.push_back(spr.current_frame);
+    start_row.push_back(spr.row_pos);
+    start_col.push_back(spr.col_pos);
+    start_frame.push_back(spr.current_frame);
+    cycle_length.push_back(count == 0 ? 1 : count);
+    first_frame.push_back(frames.size());
+    num_frames.push_back(count);
+    unsigned h = spr.get_height(), w = spr.get_width();
+    if (spr.cache == NULL) {
+        for (unsigned f = 0; f < count; ++f) {
+            h = max(h, spr.frames[f]->get_height());
+            w = max(w, spr.frames[f]->get_width());
+        }
+    }
+    height.push_back(h);
+    width.push_back(w);
+    if (spr.cache != NULL) {
+        frames.resize(frames.size() + count);
+        cached_frames.insert(cached_frames.end(), spr.cached_frames.begin(),
+                             spr.cached_frames.end());
+        cache = spr.cache;
+    } else {
+        frames.insert(frames.end(), spr.frames.begin(), spr.frames.end());
+        cached_frames.resize(cached_frames.size() + count, NO_FRAME);
+    }
+    if (layer.empty() || layer.back() != spr.layer) {
+        layer_start.push_back(layer.size());
+    }
+    layer.push_back(spr.layer);
+}
+
+
+/*  bake_static()
+ *  Purpose:  Draws the sprites that will never change onto the given
+ *            background, and removes them from the system.
+ *  Returns:  The number of sprites removed.
+ *  Notes:  - Only the static sprites at the start of the drawing order are
+ *            baked.  A static sprite drawn after a moving one must stay, or
+ *            the moving one would end up on top of it.
+ *          - The background should be the size of the canvas, and filled
+ *            with whatever the canvas would otherwise be cleared to.
+ */
+unsigned SpriteSystem::bake_static(Image<char> *background)
+{
+    unsigned count = 0;
+    while (count < size() && is_static(count)) {
+        ++count;
+    }
+    draw_range(background, 0, count);
+    erase_front(count);
+    return count;
+}
+
+
+/*  is_static()
+ *  Purpose:  A helper function that checks whether sprite i will always be
+ *            drawn the same: it has no speed, and its frame never changes.
+ */
+bool SpriteSystem::is_static(unsigned i) const
+{
+    if (v_speed[i] != 0 || h_speed[i] != 0) return false;
+    return num_frames[i] <= 1 || frame_rate[i] == 0 ||
+           fmod(frame_rate[i], cycle_length[i]) == 0;
+}
+
+
+/*  erase_front()
+ *  Purpose:  A helper function that removes the first count sprites.  Their
+ *            frames are left in the list, unused.
+ */
+void SpriteSystem::erase_front(unsigned count)
+{
+    if (count == 0) return;
+    auto erase = [count](auto &values) {
+        values.erase(values.begin(), values.begin() + count);
+    };
+    erase(row_pos);
+    erase(col_pos);
+    erase(v_speed);
+    erase(h_speed);
+    erase(frame_rate);
+    erase(current_frame);
+    erase(start_row);
+    erase(start_col);
+    erase(start_frame);
+    erase(cycle_length);
+    erase(first_frame);
+    erase(num_frames);
+    erase(height);
+    erase(width);
+    erase(layer);
+    layer_start.clear();
+    for (unsigned i = 0; i < layer.size(); ++i) {
+        if (i == 0 || layer[i] != layer[i - 1]) layer_start.push_back(i);
+    }
+}
+
+
+/*  place_all()
+ *  Purpose:  A helper function that sets value[i] to start[i] + step[i] * t
+ *            for every i, wrapped into [0, max).
+ *  Notes:  - The loop has no branches, only arithmetic on the results of
+ *            comparisons and floor(), so that the compiler can turn it into
+ *            SIMD instructions where the target has a vector floor.  GCC
+ *            needs -fno-trapping-math for that, since otherwise it keeps
+ *            each comparison as a branch.
+ */
+static void place_all(double *value, double const *start,
+                      double const *step, double t, double max,
+                      unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        double number = start[i] + step[i] * t;
+        number -= max * floor(number / max);
+        number += max * (number < 0);       // In case the division rounded
+        number -= max * (number >= max);
+        value[i] = number;
+    }
+}
+
+
+/*  place_cycles()
+ *  Purpose:  Like place_all(), but each value wraps at its own max[i].
+ */
+static void place_cycles(double *value, double const *start,
+                         double const *step, double t, double const *max,
+                         unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        double number = start[i] + step[i] * t;
+        number -= max[i] * floor(number / max[i]);
+        number += max[i] * (number < 0);
+        number -= max[i] * (number >= max[i]);
+        value[i] = number;
+    }
+}
+
+
+/*  advance()
+ *  Purpose:  Advances every sprite forward one unit of time.
+ *  Parameters: The height and width of the canvas the sprites move in.
+ *  Notes:  - The same as seek() to the next tick, so a sprite's state after
+ *            any number of steps is exactly its state at that tick, with no
+ *            rounding error built up along the way.
+ */
+void SpriteSystem::advance(unsigned canvas_height, unsigned canvas_width)
+{
+    seek(tick + 1, canvas_height, canvas_width);
+}
+
+
+/*  seek()
+ *  Purpose:  Puts every sprite in the state it is in at the given tick,
+ *            counting the state it was added in as tick 0.
+ *  Parameters: The tick.  The height and width of the canvas the sprites
+ *            move in.
+ *  Notes:  - Each piece of the state is worked out directly from where it
+ *            started, as start + speed * tick, wrapped.  So seeking costs
+ *            the same however far it goes, forward or back.
+ *          - Each array is updated in its own pass.
+ *          - With a period set, the tick is taken modulo the period.
+ */
+void SpriteSystem::seek(unsigned long to, unsigned canvas_height,
+                        unsigned canvas_width)
+{
+    tick = to;
+    unsigned count = size();
+    if (count != 0) {
+        double t = (period == 0) ? tick : tick % period;
+        place_all(&row_pos[0], &start_row[0], &v_speed[0], t,
+                  canvas_height, count);
+        place_all(&col_pos[0], &start_col[0], &h_speed[0], t,
+                  canvas_width, count);
+        place_cycles(&current_frame[0], &start_frame[0], &frame_rate[0],
+                     t, &cycle_length[0], count);
+    }
+    if (cache != NULL) prefetch();
+}
+
+
+/*  get_tick()
+ *  Purpose:  Returns the tick the sprites are at: how many times they have
+ *            advanced since being added, or where they were last sought to.
+ */
+unsigned long SpriteSystem::get_tick(void) const
+{
+    return tick;
+}
+
+
+/*  cycle_ticks()
+ *  Purpose:  A helper function that finds the fewest ticks, at the given
+ *            step per tick, that add up to a whole number of cycles of the
+ *            given length.
+ *  Returns:  The number of ticks, or 0 if it is more than limit.
+ *  Notes:  - Works through the continued fraction of step / length.  Its
+ *            convergents p / q are the best approximations with denominators
+ *            up to q, so the first one within PERIOD_TOLERANCE gives the
+ *            answer, q.
+ */
+static unsigned long cycle_ticks(double step, double length,
+                                 unsigned long limit)
+{
+    double ratio = fabs(step / length);
+    double rest = ratio;
+    unsigned long p = 1, q = 0, p_before = 0, q_before = 1;
+    for (;;) {
+        double whole = floor(rest);
+        if (whole > limit) return 0;
+        unsigned long p_next = whole * p + p_before;
+        unsigned long q_next = whole * q + q_before;
+        if (q_next > limit) return 0;
+        p_before = p;
+        q_before = q;
+        p = p_next;
+        q = q_next;
+        if (fabs(ratio * q - p) <= PERIOD_TOLERANCE) return q;
+        if (rest == whole) return 0;
+        rest = 1 / (rest - whole);
+    }
+}
+
+
+/*  find_period()
+ *  Purpose:  Finds after how many ticks every sprite is back where it
+ *            started, on the same frame.
+ *  Parameters: The height and width of the canvas the sprites move in.  The
+ *            most ticks to allow.
+ *  Returns:  The period, or 0 if there is none of at most limit ticks.
+ *  Notes:  - A sprite's row repeats once its steps add up to a whole number
+ *            of canvas heights, its column once they add up to a whole
+ *            number of canvas widths, and its frame once they add up to a
+ *            whole number of cycles.  The scene's period is the least common
+ *            multiple of all of those.
+ */
+unsigned long SpriteSystem::find_period(unsigned canvas_height,
+                                        unsigned canvas_width,
+                                        unsigned long limit) const
+{
+    if (canvas_height == 0 || canvas_width == 0) return 0;
+    unsigned long whole = 1;
+    auto include = [&whole, limit](double step, double length) {
+        unsigned long ticks = cycle_ticks(step, length, limit);
+        if (ticks == 0 || whole == 0) {
+            whole = 0;
+            return;
+        }
+        unsigned long factor = ticks / gcd(whole, ticks);
+        whole = (whole > limit / factor) ? 0 : whole * factor;
+    };
+    for (unsigned i = 0; i < size() && whole != 0; ++i) {
+        include(v_speed[i], canvas_height);
+        include(h_speed[i], canvas_width);
+        if (num_frames[i] != 0) include(frame_rate[i], cycle_length[i]);
+    }
+    return whole;
+}
+
+
+/*  set_period()
+ *  Purpose:  Sets the period found by find_period(), so that from now on
+ *            each tick is drawn exactly as that tick modulo the period.  0
+ *            counts ticks without end again.
+ *  Notes:  - Also keeps the numbers worked with small, however long the
+ *            animation runs.
+ */
+void SpriteSystem::set_period(unsigned long ticks)
+{
+    period = ticks;
+}
+
+
+/*  prefetch()
+ *  Purpose:  A helper function that asks the FrameCache for the next
+ *            PREFETCH_FRAMES frames each lazily read sprite will show.
+ *  Notes:  - A sprite slower than a frame per step shows each of the frames
+ *            after its current one in turn, so those are the ones fetched.
+ *            A faster one skips some, so the frames fetched are those it
+ *            will be on after each of its next steps.
+ */
+void SpriteSystem::prefetch(void)
+{
+    upcoming.clear();
+    for (unsigned i = 0; i < size(); ++i) {
+        if (num_frames[i] == 0 || frames[first_frame[i]] ||
+            frame_rate[i] == 0) {
+            continue;
+        }
+        double step = frame_rate[i];
+        if (fabs(step) < 1) step = (step > 0) ? 1 : -1;
+        double position = current_frame[i];
+        for (unsigned f = 0; f < PREFETCH_FRAMES; ++f) {
+            position = wrap(position + step, cycle_length[i]);
+            upcoming.push_back(
+                cached_frames[first_frame[i] + (unsigned) position]);
+        }
+    }
+    if (!upcoming.empty()) cache->prefetch(upcoming);
+}
+
+
+/*  draw_to()
+ *  Purpose:  Draws the current frame of every sprite onto the given image,
+ *            in the order the sprites were added.
+ */
+void SpriteSystem::draw_to(Image<char> *board) const
+{
+    draw_range(board, 0, size());
+}
+
+
+/*  draw_range()
+ *  Purpose:  Draws the current frames of sprites begin through end - 1 onto
+ *            the given image, in order.
+ */
+void SpriteSystem::draw_range(Image<char> *board, unsigned begin,
+                              unsigned end) const
+{
+    Rect whole = board->bounds();
+    for (unsigned i = begin; i < end; ++i) {
+        draw_one(i, board, whole);
+    }
+}
+
+
+/*  draw_one()
+ *  Purpose:  Draws the current frame of sprite i onto the given image,
+ *            changing only cells inside the clip rectangle.
+ *  Notes:  - The sprite wraps around the edges of the world, which is the
+ *            image itself unless a viewport is set.  With one, the part of
+ *            the world the image shows is drawn, and a sprite wholly
+ *            outside it is skipped without getting its frame.
+ */
+void SpriteSystem::draw_one(unsigned i, Image<char> *board,
+                            Rect const &clip) const
+{
+    if (num_frames[i] == 0) return;
+    unsigned board_height = board->get_height();
+    unsigned board_width = board->get_width();
+    if (!is_visible(i, board_height, board_width)) return;
+    Viewport view = get_viewport(board_height, board_width);
+    unsigned f = first_frame[i] + (unsigned) current_frame[i];
+    FrameHandle hold;
+    Frame const &frame = frame_at(f, &hold);
+    for_each_wrap(frame.get_height(), frame.get_width(), view.world_height,
+                  view.world_width, row_pos[i], col_pos[i],
+                  [&](int top, int left) {
+                      frame.draw_clipped(board, top - (int) view.top,
+                                         left - (int) view.left, clip);
+                  });
+}
+
+
+/*  get_placement()
+ *  Purpose:  Finds where sprite i will be drawn: the position of its
+ *            top-left corner, before wrapping, and a size no smaller than
+ *            its current frame's.
+ *  Returns:  False if the sprite has no frames, and so draws nothing.
+ *  Notes:  - The size is the one kept when the sprite was added, so no
+ *            frame is touched, and a lazy one is never loaded.
+ */
+bool SpriteSystem::get_placement(unsigned i, unsigned *row, unsigned *col,
+                                 unsigned *h, unsigned *w) const
+{
+    if (num_frames[i] == 0) return false;
+    *row = row_pos[i];
+    *col = col_pos[i];
+    *h = height[i];
+    *w = width[i];
+    return true;
+}
+
+
+/*  frame_at()
+ *  Purpose:  A helper function that returns frame f of the list of frames,
+ *            getting it from the FrameCache if it is not held here.
+ *  Parameters: The frame's place in the list.  A pointer to a handle that
+ *            keeps a frame from the cache alive while it is used.
+ *  Notes:  - Frames held here are returned without touching the handle, so
+ *            they cost no reference counting.
+ */
+Frame const &SpriteSystem::frame_at(unsigned f, FrameHandle *hold) const
+{
+    if (frames[f]) return *frames[f];
+    *hold = cache->get(cached_frames[f]);
+    return **hold;
+}
+
+
+/*  get_state()
+ *  Purpose:  Returns what decides how sprite i looks on the canvas right
+ *            now.  If two states are equal, the sprite draws identically.
+ */
+DrawState SpriteSystem::get_state(unsigned i) const
+{
+    DrawState state;
+    state.row = row_pos[i];
+    state.col = col_pos[i];
+    state.frame = (num_frames[i] == 0) ? NO_FRAME
+                  : first_frame[i] + (unsigned) current_frame[i];
+    return state;
+}
+
+
+/*  set_viewport()
+ *  Purpose:  Sets which part of the world boards show from now on.  A world
+ *            of size 0 makes each board the whole world again.
+ */
+void SpriteSystem::set_viewport(Viewport const &view)
+{
+    viewport = view;
+}
+
+
+/*  get_viewport()
+ *  Purpose:  Returns which part of the world a board of the given size
+ *            shows: the viewport that was set, or if none was, the whole of
+ *            a world the size of the board.
+ */
+Viewport SpriteSystem::get_viewport(unsigned board_height,
+                                    unsigned board_width) const
+{
+    if (viewport.world_height != 0 && viewport.world_width != 0) {
+        return viewport;
+    }
+    Viewport whole = { board_height, board_width, 0, 0 };
+    return whole;
+}
+
+
+/*  overlaps()
+ *  Purpose:  A helper function that checks whether a span of length cells
+ *            from start overlaps one of view_length cells from view_start,
+ *            along a line that wraps every world cells.
+ */
+static bool overlaps(unsigned start, unsigned length, unsigned view_start,
+                     unsigned view_length, unsigned world)
+{
+    if (length >= world || view_length >= world) return true;
+    start %= world;
+    view_start %= world;
+    return (view_start + world - start) % world < length ||
+           (start + world - view_start) % world < view_length;
+}
+
+
+/*  is_visible()
+ *  Purpose:  Checks whether any of sprite i lands on a board of the given
+ *            size, by its position and its size alone.
+ *  Notes:  - Without a viewport every sprite is visible, since it wraps
+ *            onto the board wherever it is.
+ */
+bool SpriteSystem::is_visible(unsigned i, unsigned board_height,
+                              unsigned board_width) const
+{
+    if (viewport.world_height == 0 || viewport.world_width == 0) return true;
+    return overlaps(row_pos[i], height[i], viewport.top, board_height,
+                    viewport.world_height) &&
+           overlaps(col_pos[i], width[i], viewport.left, board_width,
+                    viewport.world_width);
+}
+
+
+/*  size()
+ *  Purpose:  Returns the number of sprites in the system.
+ */
+unsigned SpriteSystem::size(void) const
+{
+    return row_pos.size();
+}
+
+
+/*  num_layers()
+ *  Purpose:  Returns the number of layers: runs of sprites, in drawing
+ *            order, that share a layer number.
+ */
+unsigned SpriteSystem::num_layers(void) const
+{
+    return layer_start.size();
+}
+
+
+/*  layer_begin(), layer_end()
+ *  Purpose:  Return the first sprite in layer l, and one past its last.
+ */
+unsigned SpriteSystem::layer_begin(unsigned l) const
+{
+    return layer_start[l];
+}
+
+unsigned SpriteSystem::layer_end(unsigned l) const
+{
+    return (l + 1 < layer_start.size()) ? layer_start[l + 1] : size();
+}
@@ -0,0 +1,149 @@
+/*---------------------------------------------------------------------------*\
+ *  sprite_system.h                                                          *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the SpriteSystem class, which holds every sprite in a scene and  *
+ *    moves and draws them all at once.                                      *
+ *  Rather than keeping a list of Sprite objects, the system keeps each      *
+ *    piece of a sprite's moving state (row, column, speeds, frame rate and  *
+ *    current frame) in its own array, indexed by sprite.  advance() can     *
+ *    then update a whole array in one tight loop, which the compiler is     *
+ *    able to vectorize.  Handles to the frames of all sprites are kept      *
+ *    together in a single list, with each sprite recording where its own    *
+ *    frames start; frames shared between sprites are not copied.            *
+ *  Every sprite moves in a straight line and through its frames at a        *
+ *    steady rate, so the system keeps where each one started and counts     *
+ *    ticks.  Its state at any tick is worked out directly from its start,   *
+ *    which lets seek() jump to any tick at once, and means advancing to a   *
+ *    tick step by step gives exactly the same state as seeking to it.       *
+ *  If every speed and frame rate is a simple enough fraction, the whole     *
+ *    scene repeats, and find_period() can say after how many ticks.  Once   *
+ *    set_period() is given that, ticks are counted around the cycle, so     *
+ *    tick t always looks exactly like tick t modulo the period.             *
+ *  Sprites are drawn in the order they were added.  A system built from a   *
+ *    list of sprites adds them sorted by layer, keeping the list's order    *
+ *    within each layer.  Sprites next to each other in drawing order that   *
+ *    share a layer form a layer of the system, which can be drawn on its    *
+ *    own with draw_range().                                                 *
+ *  Sprites that will never move or change frame can be drawn once into a    *
+ *    background image and removed from the system with bake_static().       *
+ *  Frames of sprites read lazily are got from their FrameCache as they are  *
+ *    drawn.  Each time the system advances, it asks the cache to prefetch   *
+ *    the next few frames each such sprite will show, going by its frame     *
+ *    rate.                                                                  *
+ *  A board need not show the whole world.  Given a Viewport, the system     *
+ *    draws only the part of the world it covers, and skips every sprite     *
+ *    that lies wholly outside it without touching its frames, so a large,   *
+ *    sparse world costs little more to draw than what is on screen.         *
+\*---------------------------------------------------------------------------*/
+#ifndef SPRITE_SYSTEM_H_
+#define SPRITE_SYSTEM_H_
+#include <vector>
+#include "image.h"
+#include "frame.h"
+#include "frame_atlas.h"
+#include "sprite.h"
+
+class FrameCache;
+
+/*  Everything that decides what a sprite looks like on the canvas: where
+ *    its frame is drawn, and which frame.  A sprite with no frames has a
+ *    frame of NO_FRAME.
+ */
+struct DrawState
+{
+    unsigned row, col, frame;
+};
+
+inline bool operator==(DrawState const &a, DrawState const &b)
+{
+    return a.row == b.row && a.col == b.col && a.frame == b.frame;
+}
+
+inline bool operator!=(DrawState const &a, DrawState const &b)
+{
+    return !(a == b);
+}
+
+
+/*  Which part of the world a board shows.  Sprites move in, and wrap around
+ *    the edges of, a world of world_height by world_width cells.  A board
+ *    shows the part of it with its top-left corner at (top, left).  A world
+ *    of size 0 means that each board is the whole world.
+ */
+struct Viewport
+{
+    unsigned world_height, world_width;
+    unsigned top, left;
+};
+
+inline bool operator==(Viewport const &a, Viewport const &b)
+{
+    return a.world_height == b.world_height &&
+           a.world_width == b.world_width && a.top == b.top &&
+           a.left == b.left;
+}
+
+inline bool operator!=(Viewport const &a, Viewport const &b)
+{
+    return !(a == b);
+}
+
+
+class SpriteSystem
+{
+public:
+    static constexpr unsigned NO_FRAME = ~0u;
+
+    SpriteSystem(void);
+    SpriteSystem(std::vector<Sprite> const &sprites);
+
+    void add(Sprite const &spr);
+    unsigned bake_static(Image<char> *background);
+    void advance(unsigned canvas_height, unsigned canvas_width);
+    void seek(unsigned long to, unsigned canvas_height,
+              unsigned canvas_width);
+    unsigned long get_tick(void) const;
+    unsigned long find_period(unsigned canvas_height, unsigned canvas_width,
+                              unsigned long limit) const;
+    void set_period(unsigned long ticks);
+    void draw_to(Image<char> *board) const;
+    void draw_range(Image<char> *board, unsigned begin, unsigned end) const;
+    void draw_one(unsigned i, Image<char> *board, Rect const &clip) const;
+    bool get_placement(unsigned i, unsigned *row, unsigned *col,
+                       unsigned *h, unsigned *w) const;
+    DrawState get_state(unsigned i) const;
+    unsigned size(void) const;
+
+    void set_viewport(Viewport const &view);
+    Viewport get_viewport(unsigned board_height, unsigned board_width) const;
+    bool is_visible(unsigned i, unsigned board_height,
+                    unsigned board_width) const;
+
+    unsigned num_layers(void) const;
+    unsigned layer_begin(unsigned l) const;
+    unsigned layer_end(unsigned l) const;
+
+private:
+    bool is_static(unsigned i) const;
+    void erase_front(unsigned count);
+    Frame const &frame_at(unsigned f, FrameHandle *hold) const;
+    void prefetch(void);
+    std::vector<double> row_pos, col_pos;
+    std::vector<double> v_speed, h_speed;
+    std::vector<double> frame_rate, current_frame;
+    std::vector<double> start_row, start_col, start_frame;
+    std::vector<double> cycle_length;
+    std::vector<unsigned> first_frame, num_frames;
+    std::vector<unsigned> height, width;
+    std::vector<FrameHandle> frames;
+    std::vector<unsigned> cached_frames;
+    FrameCache *cache;
+    std::vector<unsigned> upcoming;
+    std::vector<int> layer;
+    std::vector<unsigned> layer_start;
+    unsigned long tick, period;
+    Viewport viewport;
+};
+
+#endif
@@ -0,0 +1,188 @@
+/*---------------------------------------------------------------------------*\
+ *  terminal.cpp                                                             *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the TerminalSession class.                       *
+\*---------------------------------------------------------------------------*/
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "terminal.h"
+
+static const int SIGNALS[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT };
+static const unsigned NUM_SIGNALS = sizeof(SIGNALS) / sizeof(SIGNALS[0]);
+static const char HIDE_CURSOR[] = "\033[?25l";
+static const char SHOW_CURSOR[] = "\033[?25h";
+
+//  What to put back, kept outside the class so the signal handler can reach
+//    it.  Only what the session actually changed is restored.
+static struct termios saved_tty;
+static bool tty_changed = false;
+static bool cursor_hidden = false;
+
+//  Set by SIGWINCH, and cleared when was_resized() reports it.
+static volatile sig_atomic_t resized = 0;
+
+
+/*  restore_terminal()
+ *  Purpose:  Puts back the terminal settings and the cursor.
+ *  Notes:  - Uses only calls that are safe in a signal handler.
+ */
+static void restore_terminal(void)
+{
+    if (tty_changed) {
+        tcsetattr(0, TCSANOW, &saved_tty);
+        tty_changed = false;
+    }
+    if (cursor_hidden) {
+        ssize_t ignored = write(1, SHOW_CURSOR, sizeof(SHOW_CURSOR) - 1);
+        (void) ignored;
+        cursor_hidden = false;
+    }
+}
+
+
+/*  on_signal()
+ *  Purpose:  Restores the terminal, then lets the signal do what it would
+ *            have done anyway.
+ */
+static void on_signal(int sig)
+{
+    restore_terminal();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+
+/*  on_resize()
+ *  Purpose:  Notes that the terminal has changed size.
+ */
+static void on_resize(int)
+{
+    resized = 1;
+}
+
+
+/*  Constructor turns off echo and line buffering on standard input and hides
+ *    the cursor on standard output, each only if it is a terminal.
+ */
+TerminalSession::TerminalSession(void)
+{
+    eof = false;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    for (unsigned i = 0; i < NUM_SIGNALS; ++i) {
+        sigaction(SIGNALS[i], &action, &previous[i]);
+    }
+    action.sa_handler = on_resize;
+    sigaction(SIGWINCH, &action, &previous_winch);
+    resized = 0;
+    if (isatty(0) && tcgetattr(0, &saved_tty) == 0) {
+        struct termios raw = saved_tty;
+        raw.c_lflag &= ~(ECHO | ICANON);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tty_changed = (tcsetattr(0, TCSANOW, &raw) == 0);
+    }
+    if (isatty(1)) {
+        cursor_hidden = (write(1, HIDE_CURSOR, sizeof(HIDE_CURSOR) - 1) > 0);
+    }
+}
+
+
+/*  Destructor restores the terminal and the previous signal handlers.
+ */
+TerminalSession::~TerminalSession(void)
+{
+    restore_terminal();
+    for (unsigned i = 0; i < NUM_SIGNALS; ++i) {
+        sigaction(SIGNALS[i], &previous[i], NULL);
+    }
+    sigaction(SIGWINCH, &previous_winch, NULL);
+}
+
+
+/*  input_fd()
+ *  Purpose:  Returns the file descriptor to wait on for keys, or -1 once
+ *            input has ended and there is nothing left to wait for.
+ */
+int TerminalSession::input_fd(void) const
+{
+    return eof ? -1 : 0;
+}
+
+
+/*  read_key()
+ *  Purpose:  Waits for a key and returns it.
+ *  Returns:  '\0' if input has ended.
+ */
+char TerminalSession::read_key(void)
+{
+    if (eof) return '\0';
+    struct pollfd input = { 0, POLLIN, 0 };
+    while (poll(&input, 1, -1) < 0 && errno == EINTR) {
+    }
+    return read_ready_key();
+}
+
+
+/*  read_ready_key()
+ *  Purpose:  Reads a key that poll() has said is ready.
+ *  Returns:  '\0' if input has ended, which is also remembered.
+ */
+char TerminalSession::read_ready_key(void)
+{
+    char c;
+    ssize_t got;
+    while ((got = read(0, &c, 1)) < 0 && errno == EINTR) {
+    }
+    if (got != 1) {
+        eof = true;
+        return '\0';
+    }
+    return c;
+}
+
+
+/*  at_eof()
+ *  Purpose:  Returns whether input has ended.
+ */
+bool TerminalSession::at_eof(void) const
+{
+    return eof;
+}
+
+
+/*  was_resized()
+ *  Purpose:  Returns whether the terminal has been resized since the last
+ *            time this was asked, or since the session began.
+ */
+bool TerminalSession::was_resized(void)
+{
+    if (!resized) return false;
+    resized = 0;
+    return true;
+}
+
+
+/*  get_size()
+ *  Purpose:  Finds the size of the terminal on standard output, in rows and
+ *            columns.
+ *  Returns:  False, leaving both as they were, if standard output is not a
+ *            terminal or its size is not known.
+ */
+bool TerminalSession::get_size(unsigned *height, unsigned *width)
+{
+    struct winsize size;
+    if (ioctl(1, TIOCGWINSZ, &size) != 0 || size.ws_row == 0 ||
+        size.ws_col == 0) {
+        return false;
+    }
+    *height = size.ws_row;
+    *width = size.ws_col;
+    return true;
+}
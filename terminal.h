@@ -0,0 +1,43 @@
+/*---------------------------------------------------------------------------*\
+ *  terminal.h                                                               *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the TerminalSession class, which sets the terminal up for an     *
+ *    animation once, and puts it back the way it was afterwards.            *
+ *  While a session exists, keys are read one at a time without echo, and    *
+ *    the cursor is hidden.  The terminal is restored when the session is    *
+ *    destroyed, or if the program is killed by SIGINT, SIGTERM, SIGHUP or   *
+ *    SIGQUIT.  Only one session should exist at a time.                     *
+ *  Unlike getacharnow(), reading a key makes no terminal settings calls and *
+ *    does not flush cout.  Input is meant to be waited for with poll(), as  *
+ *    FrameScheduler::wait_for_input() does, and read only once it is ready. *
+ *  The session also notes when the terminal is resized (SIGWINCH), so that  *
+ *    the animation can ask, once per frame, whether it should fit itself to *
+ *    the new size.                                                          *
+\*---------------------------------------------------------------------------*/
+#ifndef TERMINAL_H_
+#define TERMINAL_H_
+#include <signal.h>
+#include <termios.h>
+
+class TerminalSession
+{
+public:
+    TerminalSession(void);
+    ~TerminalSession(void);
+
+    int input_fd(void) const;
+    char read_key(void);
+    char read_ready_key(void);
+    bool at_eof(void) const;
+    bool was_resized(void);
+    static bool get_size(unsigned *height, unsigned *width);
+
+private:
+    TerminalSession(TerminalSession const &);
+    TerminalSession &operator=(TerminalSession const &);
+    bool eof;
+    struct sigaction previous[4], previous_winch;
+};
+
+#endif
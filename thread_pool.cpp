@@ -0,0 +1,169 @@
+/*---------------------------------------------------------------------------*\
+ *  thread_pool.cpp                                                          *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the methods for the ThreadPool class.                            *
+\*---------------------------------------------------------------------------*/
+#include "thread_pool.h"
+using namespace std;
+
+
+/*  pack()
+ *  Purpose:  A helper function that combines the front and back of a range
+ *            of task numbers into a single word for a Queue.
+ */
+static uint64_t pack(unsigned front, unsigned back)
+{
+    return ((uint64_t) front << 32) | back;
+}
+
+
+/*  Constructor starts threads - 1 worker threads; the thread calling run()
+ *    is the last one.  A count of 0 is treated as 1.
+ */
+ThreadPool::ThreadPool(unsigned threads)
+{
+    count = (threads == 0) ? 1 : threads;
+    queues.reset(new Queue[count]);
+    for (unsigned i = 0; i < count; ++i) {
+        queues[i].range.store(0);
+    }
+    job = NULL;
+    generation = 0;
+    busy = 0;
+    stopping = false;
+    for (unsigned i = 1; i < count; ++i) {
+        workers.push_back(thread(&ThreadPool::worker_loop, this, i));
+    }
+}
+
+
+/*  Destructor stops and joins the worker threads.
+ */
+ThreadPool::~ThreadPool(void)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    start.notify_all();
+    for (unsigned i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+
+/*  run()
+ *  Purpose:  Calls task(i) once for every i in [0, tasks), spread over the
+ *            pool's threads, and returns when every call has finished.
+ *  Notes:  - Calls may happen in any order and at the same time, so tasks
+ *            must not depend on each other.
+ *          - Only one thread may call run() at a time.
+ */
+void ThreadPool::run(unsigned tasks, function<void(unsigned)> const &task)
+{
+    if (count == 1 || tasks <= 1) {
+        for (unsigned i = 0; i < tasks; ++i) task(i);
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        for (unsigned i = 0; i < count; ++i) {
+            unsigned front = (unsigned long) tasks * i / count;
+            unsigned back = (unsigned long) tasks * (i + 1) / count;
+            queues[i].range.store(pack(front, back));
+        }
+        job = &task;
+        busy = count;
+        ++generation;
+    }
+    start.notify_all();
+    work(0);
+    unique_lock<mutex> guard(lock);
+    finish.wait(guard, [this] { return busy == 0; });
+    job = NULL;
+}
+
+
+/*  size()
+ *  Purpose:  Returns the number of threads that work on tasks, including the
+ *            one calling run().
+ */
+unsigned ThreadPool::size(void) const
+{
+    return count;
+}
+
+
+/*  work()
+ *  Purpose:  A helper function that runs the tasks in the given thread's own
+ *            queue, then steals from the others until every queue is empty.
+ */
+void ThreadPool::work(unsigned self)
+{
+    unsigned task;
+    while (take_front(self, &task)) {
+        (*job)(task);
+    }
+    for (unsigned offset = 1; offset < count; ++offset) {
+        unsigned victim = (self + offset) % count;
+        while (take_back(victim, &task)) {
+            (*job)(task);
+        }
+    }
+    lock_guard<mutex> guard(lock);
+    if (--busy == 0) finish.notify_one();
+}
+
+
+/*  take_front(), take_back()
+ *  Purpose:  Helper functions that remove one task number from the front or
+ *            back of the given queue.
+ *  Returns:  True and sets *task if the queue had one, false if it was empty.
+ */
+bool ThreadPool::take_front(unsigned queue, unsigned *task)
+{
+    atomic<uint64_t> &range = queues[queue].range;
+    uint64_t current = range.load();
+    for (;;) {
+        unsigned front = current >> 32, back = (unsigned) current;
+        if (front >= back) return false;
+        if (range.compare_exchange_weak(current, pack(front + 1, back))) {
+            *task = front;
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::take_back(unsigned queue, unsigned *task)
+{
+    atomic<uint64_t> &range = queues[queue].range;
+    uint64_t current = range.load();
+    for (;;) {
+        unsigned front = current >> 32, back = (unsigned) current;
+        if (front >= back) return false;
+        if (range.compare_exchange_weak(current, pack(front, back - 1))) {
+            *task = back - 1;
+            return true;
+        }
+    }
+}
+
+
+/*  worker_loop()
+ *  Purpose:  The body of each worker thread: waits for run() to hand out a
+ *            new batch of tasks, then helps with it.
+ */
+void ThreadPool::worker_loop(unsigned self)
+{
+    unsigned long seen = 0;
+    for (;;) {
+        {
+            unique_lock<mutex> guard(lock);
+            start.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        work(self);
+    }
+}
@@ -0,0 +1,61 @@
+/*---------------------------------------------------------------------------*\
+ *  thread_pool.h                                                            *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the ThreadPool class, a fixed set of threads that run numbered   *
+ *    tasks in parallel.                                                     *
+ *  run() hands out tasks 0 through n - 1 and returns once all of them are   *
+ *    done.  The calling thread works on tasks too, so a pool of size 1 has  *
+ *    no extra threads at all and runs everything in order.                  *
+ *  Each thread starts with its own contiguous block of task numbers, taken  *
+ *    from the front.  A thread that runs out steals from the back of some   *
+ *    other thread's block, so uneven tasks still keep every thread busy.    *
+\*---------------------------------------------------------------------------*/
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned threads);
+    ~ThreadPool(void);
+
+    void run(unsigned tasks, std::function<void(unsigned)> const &task);
+    unsigned size(void) const;
+
+private:
+    //  The range of task numbers a thread has left, packed as front in the
+    //    high half and back in the low half so both change in one step.
+    //    Each sits on its own cache line.
+    struct alignas(64) Queue
+    {
+        std::atomic<uint64_t> range;
+    };
+
+    ThreadPool(ThreadPool const &);
+    ThreadPool &operator=(ThreadPool const &);
+    void work(unsigned self);
+    bool take_front(unsigned queue, unsigned *task);
+    bool take_back(unsigned queue, unsigned *task);
+    void worker_loop(unsigned self);
+
+    unsigned count;
+    std::unique_ptr<Queue[]> queues;
+    std::vector<std::thread> workers;
+    std::function<void(unsigned)> const *job;
+    std::mutex lock;
+    std::condition_variable start, finish;
+    unsigned long generation;
+    unsigned busy;
+    bool stopping;
+};
+
+#endif
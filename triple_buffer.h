@@ -0,0 +1,158 @@
+/*---------------------------------------------------------------------------*\
+ *  triple_buffer.h                                                          *
+ *  Written by: Colin Hamilton, Tufts University                             *
+ *                                                                           *
+ *  Defines the TripleBuffer class, which passes the latest of a stream of   *
+ *    values from one thread to another without locks.                       *
+ *  There are three buffers.  The producer fills the back one and publishes  *
+ *    it, which swaps it with the middle one.  The consumer takes the middle *
+ *    one, if anything new was published, by swapping it with the front one  *
+ *    it has finished with.  Each swap is a single atomic exchange, so the   *
+ *    producer never waits for the consumer, and the consumer only ever      *
+ *    waits when there is nothing new to take.  A value published while the  *
+ *    consumer is busy replaces the one before it, which is never seen.      *
+ *                                                                           *
+ *  The class is defined with template parameters, so it can hold anything   *
+ *    that can be assigned, such as an Image.                                *
+\*---------------------------------------------------------------------------*/
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer(void);
+    TripleBuffer(T const &initial);
+
+    T &get_back(void);
+    void publish(void);
+
+    bool update(void);
+    bool wait_for_update(void);
+    T const &get_front(void) const;
+
+    void close(void);
+
+private:
+    TripleBuffer(TripleBuffer const &);
+    TripleBuffer &operator=(TripleBuffer const &);
+
+    //  The middle word holds the index of the middle buffer in its low bits,
+    //    and flags for whether it is newly published and whether the
+    //    producer is finished.
+    static const unsigned INDEX = 3;
+    static const unsigned FRESH = 4;
+    static const unsigned CLOSED = 8;
+
+    T buffers[3];
+    unsigned back, front;
+    std::atomic<unsigned> middle;
+};
+
+
+/*  Default constructor makes three default values.
+ */
+template <typename T>
+TripleBuffer<T>::TripleBuffer(void) : back(0), front(1), middle(2)
+{
+}
+
+
+/*  Overloaded constructor starts every buffer as a copy of the given value,
+ *    so they all have the right size before anything is published.
+ */
+template <typename T>
+TripleBuffer<T>::TripleBuffer(T const &initial)
+    : buffers{ initial, initial, initial }, back(0), front(1), middle(2)
+{
+}
+
+
+/*  get_back()
+ *  Purpose:  Returns the buffer the producer should fill next.
+ *  Notes:  - Only the producer thread may call this and publish().
+ *          - The buffer holds whatever was last published from it, or
+ *            skipped, so it must be filled in completely.
+ */
+template <typename T>
+T &TripleBuffer<T>::get_back(void)
+{
+    return buffers[back];
+}
+
+
+/*  publish()
+ *  Purpose:  Hands the back buffer to the consumer, replacing anything it
+ *            has not taken yet, and wakes the consumer if it is waiting.
+ */
+template <typename T>
+void TripleBuffer<T>::publish(void)
+{
+    unsigned old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    back = old & INDEX;
+    middle.notify_one();
+}
+
+
+/*  update()
+ *  Purpose:  Makes the newest published value the front buffer, if there is
+ *            one the consumer has not taken yet.
+ *  Returns:  True if the front buffer changed.
+ *  Notes:  - Only the consumer thread may call this, wait_for_update() and
+ *            get_front().
+ */
+template <typename T>
+bool TripleBuffer<T>::update(void)
+{
+    if (!(middle.load(std::memory_order_acquire) & FRESH)) return false;
+    unsigned old = middle.exchange(front, std::memory_order_acq_rel);
+    front = old & INDEX;
+    if (old & CLOSED) middle.fetch_or(CLOSED, std::memory_order_release);
+    return true;
+}
+
+
+/*  wait_for_update()
+ *  Purpose:  Like update(), but if nothing new has been published, sleeps
+ *            until something is or the buffer is closed.
+ *  Returns:  False once the buffer is closed and every value published
+ *            before that has been taken.
+ */
+template <typename T>
+bool TripleBuffer<T>::wait_for_update(void)
+{
+    unsigned current = middle.load(std::memory_order_acquire);
+    while (!(current & (FRESH | CLOSED))) {
+        middle.wait(current, std::memory_order_acquire);
+        current = middle.load(std::memory_order_acquire);
+    }
+    return update();
+}
+
+
+/*  get_front()
+ *  Purpose:  Returns the value the consumer took last.
+ */
+template <typename T>
+T const &TripleBuffer<T>::get_front(void) const
+{
+    return buffers[front];
+}
+
+
+/*  close()
+ *  Purpose:  Tells the consumer that nothing more will be published, and
+ *            wakes it if it is waiting.
+ *  Notes:  - Only the producer thread may call this, and it may not publish
+ *            anything afterwards.
+ */
+template <typename T>
+void TripleBuffer<T>::close(void)
+{
+    middle.fetch_or(CLOSED, std::memory_order_release);
+    middle.notify_one();
+}
+
+#endif